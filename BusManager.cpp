@@ -1,4 +1,9 @@
 #include "BusManager.h"
+#include "FrozenNetwork.h"
+#include "Haversine.h"
+#include "utility/parallel.h"
+#include <algorithm>
+#include <limits>
 #include <stdexcept>
 
 #ifdef _DEBUG
@@ -11,17 +16,25 @@ namespace bus {
 //---------------------------------------------------------------
 // StopRecord
 
-StopRecord::StopRecord(std::string name) : name_(std::move(name)) {
+StopRecord::StopRecord(std::string_view name) : name_(name) {
 }
 
-StopRecord::StopRecord(std::string name, Coordinates place)
-    : name_(std::move(name)), place_(std::move(place)), initialized_(true) {
+StopRecord::StopRecord(std::string_view name, Coordinates place)
+    : place_(std::move(place)), name_(name), initialized_(true) {
+}
+
+StopRecord::StopRecord(std::string_view name, StopId id)
+    : id_(id), name_(name) {
 }
 
 const std::string_view StopRecord::GetName() const noexcept {
   return name_;
 }
 
+StopId StopRecord::GetId() const noexcept {
+  return id_;
+}
+
 void StopRecord::SetCoordinates(Coordinates place) {
 
 
@@ -33,55 +46,19 @@ const Coordinates& StopRecord::GetCoordinates() const noexcept {
   return place_;
 }
 
-void StopRecord::AddBus(std::string_view bus) {
-  buses_.insert(bus);
-}
-
-const std::set<std::string_view>& StopRecord::GetBuses() const noexcept {
-  return buses_;
-}
-
-//void StopRecord::AddDist(std::string_view name, size_t dist) {
-//  auto it = distances_.find(name);
-//  if (it == distances_.end()) {
-//    distances_.insert({name, dist});
-//  }
-//}
-
- void StopRecord::SetDist(std::string_view name, size_t dist) {
-  distances_[name] = dist;
- }
-
-[[nodiscard]] std::optional<size_t> StopRecord::GetDist(
-    std::string_view finish) const noexcept {
-  auto it = distances_.find(finish);
-  if (it != distances_.end()) {
-    return it->second;
-  }
-  return std::nullopt;
-}
-
-inline void SetDistIfNotExist(StopRecord& record, std::string_view name,
-                              size_t dist) {
-  auto maybe_dist = record.GetDist(name);
-  if (!maybe_dist) {
-    record.SetDist(name, dist);
-  }
-}
-
 
 //-------------------------------------------------------------
 // BusRecord
 
-BusRecord::BusRecord(RouteType type, std::string name)
-    : type_(type), name_(std::move(name)) {
+BusRecord::BusRecord(RouteType type, std::string_view name)
+    : name_(name), type_(type) {
 }
 
-void BusRecord::AddStop(StopRecordPtr ptr) {
-  stops_.push_back(StopRecordWeakPtr(ptr));
+void BusRecord::AddStop(StopId id) {
+  stops_.push_back(id);
 }
 
-auto BusRecord::GetStops() const -> const std::vector<StopRecordWeakPtr>& {
+auto BusRecord::GetStops() const -> const std::vector<StopId>& {
   return stops_;
 }
 
@@ -89,20 +66,29 @@ const std::string_view BusRecord::GetName() const noexcept {
   return name_;
 }
 
-double BusRecord::GetGeomLength() const {
+double BusRecord::GetGeomLength(const StopArena& stops) const {
+  if (type_ == RouteType::Circular) {
+    return CalculateLength(stops_.begin(), stops_.end(), stops);
+  } else {
+    return CalculateLength(stops_.begin(), stops_.end(), stops) * 2;
+  }
+}
+
+double BusRecord::GetGeomLength(const CoordinateTable& coordinates) const {
   if (type_ == RouteType::Circular) {
-    return CalculateLength(stops_.begin(), stops_.end());
+    return coordinates.LineLength(stops_);
   } else {
-    return CalculateLength(stops_.begin(), stops_.end()) * 2;
+    return coordinates.LineLength(stops_) * 2;
   }
 }
 
-double BusRecord::GetRouteLength() const {
+double BusRecord::GetRouteLength(const StopArena& stops,
+                                 const RoadDistanceTable& distances) const {
   if (type_ == RouteType::Circular) {
-    return CalculateRouteLength(stops_.begin(), stops_.end());
+    return CalculateRouteLength(stops_.begin(), stops_.end(), stops, distances);
   } else {
-    return CalculateRouteLength(stops_.begin(), stops_.end()) +
-           CalculateRouteLength(stops_.rbegin(), stops_.rend());
+    return CalculateRouteLength(stops_.begin(), stops_.end(), stops, distances) +
+           CalculateRouteLength(stops_.rbegin(), stops_.rend(), stops, distances);
   }
 }
 
@@ -111,7 +97,9 @@ BusRecord::RouteType BusRecord::GetType() const {
 }
 
 size_t BusRecord::GetUniqueStops() const {
-  return std::set<StopRecordWeakPtr, std::owner_less<StopRecordWeakPtr>>(stops_.begin(), stops_.end()).size();
+  std::vector<StopId> unique(stops_);
+  std::sort(unique.begin(), unique.end());
+  return std::unique(unique.begin(), unique.end()) - unique.begin();
 }
 
 [[nodiscard]] size_t BusRecord::GetStopsOnRoute() const {
@@ -122,45 +110,243 @@ size_t BusRecord::GetUniqueStops() const {
   }
 }
 
+void BusRecord::PrecomputeStats(const CoordinateTable& coordinates,
+                                const StopArena& stops,
+                                const RoadDistanceTable& distances) {
+  BusStats stats;
+  stats.route_length = GetRouteLength(stops, distances);
+  stats.geom_length = GetGeomLength(coordinates);
+  stats.unique_stops = GetUniqueStops();
+  stats.stops_on_route = GetStopsOnRoute();
+  stats_ = stats;
+}
+
+BusStats BusRecord::GetStats(const StopArena& stops,
+                             const RoadDistanceTable& distances) const {
+  if (stats_) {
+    return *stats_;
+  }
+  BusStats stats;
+  stats.route_length = GetRouteLength(stops, distances);
+  stats.geom_length = GetGeomLength(stops);
+  stats.unique_stops = GetUniqueStops();
+  stats.stops_on_route = GetStopsOnRoute();
+  return stats;
+}
+
 //-------------------------------------------------------
 // BusManager
 
 void BusManager::AddBus(const std::string& name, const std::vector<std::string>& stops,
                         BusRecord::RouteType type) {
-  BusRecordPtr record = std::make_shared<BusRecord>(type, name);
+  const NameId name_id = names_.Intern(name);
+  BusRecordPtr record = std::make_shared<BusRecord>(type, names_.Get(name_id));
   for (const auto& stop : stops) {
-    auto stop_record = GetRecord(stop_index_, stop);
-
-    if (!stop_record) {
-      StopRecordPtr new_stop_record = std::make_shared<StopRecord>(stop);
-      new_stop_record->AddBus(record->GetName());
-      AddRecord(stop_index_, new_stop_record);
-      record->AddStop(new_stop_record);
-    } else {
-      (*stop_record)->AddBus(record->GetName());
-      record->AddStop(*stop_record); 
-    }
+    record->AddStop(GetOrCreateStop(stop));
   }
-  AddRecord(bus_index_, record);
+  AddRecord(bus_index_, name_id, std::move(record));
 }
 
 void BusManager::AddStop(
     const std::string& name, const Coordinates& pos,
     const std::vector<std::pair<std::string, size_t>>& dist) {
 
-  auto record = GetOrCreateRecord(stop_index_, name);
-  record->SetCoordinates(pos);
+  const StopId id = GetOrCreateStop(name);
+  stops_[id].SetCoordinates(pos);
 
   for (const auto& [other_name, length] : dist) {
-    auto other_record = GetOrCreateRecord(stop_index_, other_name);
-    record->SetDist(other_record->GetName(), length);
-    SetDistIfNotExist(*other_record, record->GetName(), length);
+    const StopId other_id = GetOrCreateStop(other_name);
+    distances_.Set(id, other_id, length);
+    distances_.SetIfNotExist(other_id, id, length);
+  }
+}
+
+void BusManager::AddTrip(const std::string& bus,
+                         const std::vector<double>& times) {
+  trips_.push_back({names_.Get(names_.Intern(bus)), times});
+}
+
+void BusManager::PrecomputeBusStats() {
+  std::vector<BusRecord*> buses;
+  for (const auto& record_ptr : bus_index_) {
+    if (record_ptr) {
+      buses.push_back(record_ptr->get());
+    }
+  }
+
+  CoordinateTable coordinates;
+  coordinates.Build(stops_);
+
+  // Every bus is written by exactly one worker
+  utility::ParallelChunks(buses.size(), [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      buses[i]->PrecomputeStats(coordinates, stops_, distances_);
+    }
+  });
+}
+
+void BusManager::FinishLoading() {
+  if (loaded_) {
+    return;
   }
-  AddRecord(stop_index_, record);
+  distances_.Freeze(stops_.size());
+  names_.Freeze();
+  BuildStopBuses();
+  PrecomputeBusStats();
+  loaded_ = true;
+}
+
+void BusManager::BuildStopBuses() {
+  std::vector<NameId> bus_names;
+  for (NameId name = 0; name < bus_index_.size(); ++name) {
+    if (bus_index_[name]) {
+      bus_names.push_back(name);
+    }
+  }
+  std::sort(bus_names.begin(), bus_names.end(), [this](NameId lhs, NameId rhs) {
+    return names_.Get(lhs) < names_.Get(rhs);
+  });
+
+  // Buses are visited in name order, so lists come out sorted, and a bus
+  // passing a stop twice is counted once as it is the last one seen there
+  static constexpr NameId kNoBus = std::numeric_limits<NameId>::max();
+  std::vector<NameId> last_bus(stops_.size(), kNoBus);
+  stop_bus_offsets_.assign(stops_.size() + 1, 0);
+  for (NameId name : bus_names) {
+    for (StopId stop : (*bus_index_[name])->GetStops()) {
+      if (last_bus[stop] != name) {
+        last_bus[stop] = name;
+        ++stop_bus_offsets_[stop + 1];
+      }
+    }
+  }
+  for (size_t stop = 0; stop < stops_.size(); ++stop) {
+    stop_bus_offsets_[stop + 1] += stop_bus_offsets_[stop];
+  }
+
+  stop_buses_.resize(stop_bus_offsets_.back());
+  std::vector<uint32_t> fill(stop_bus_offsets_.begin(), stop_bus_offsets_.end() - 1);
+  last_bus.assign(stops_.size(), kNoBus);
+  for (NameId name : bus_names) {
+    for (StopId stop : (*bus_index_[name])->GetStops()) {
+      if (last_bus[stop] != name) {
+        last_bus[stop] = name;
+        stop_buses_[fill[stop]++] = name;
+      }
+    }
+  }
+}
+
+std::shared_ptr<const FrozenNetwork> BusManager::Freeze() {
+  return std::make_shared<const FrozenNetwork>(TakeTables());
+}
+
+NetworkTables BusManager::TakeTables() {
+  FinishLoading();
+
+  NetworkTables tables;
+  tables.stop_by_name.assign(names_.Size(), NetworkTables::kNoRecord);
+  tables.bus_by_name.assign(names_.Size(), NetworkTables::kNoRecord);
+  tables.stop_names.resize(stops_.size());
+  for (NameId name = 0; name < stop_index_.size(); ++name) {
+    if (const auto& stop = stop_index_[name]) {
+      tables.stop_by_name[name] = *stop;
+      tables.stop_names[*stop] = name;
+    }
+  }
+  tables.stop_places.reserve(stops_.size());
+  for (const auto& stop : stops_) {
+    tables.stop_places.push_back(stop.GetCoordinates());
+  }
+  tables.stop_bus_offsets = std::move(stop_bus_offsets_);
+  tables.stop_buses = std::move(stop_buses_);
+
+  for (NameId name = 0; name < bus_index_.size(); ++name) {
+    if (!bus_index_[name]) {
+      continue;
+    }
+    const BusRecord& bus = **bus_index_[name];
+    const auto& stops = bus.GetStops();
+    tables.bus_by_name[name] = static_cast<uint32_t>(tables.buses.size());
+    tables.buses.push_back({name, bus.GetType(), bus.GetStats(stops_, distances_),
+                            static_cast<uint32_t>(tables.bus_stops.size()),
+                            static_cast<uint32_t>(stops.size())});
+    tables.bus_stops.insert(tables.bus_stops.end(), stops.begin(), stops.end());
+  }
+  tables.distances = std::move(distances_);
+  tables.trips = std::move(trips_);
+
+  // Records refer to the pool, so they go first
+  stop_index_ = {};
+  bus_index_ = {};
+  stops_ = {};
+  trips_ = {};
+  tables.names = std::move(names_);
+  names_ = NamePool{};
+  distances_ = RoadDistanceTable{};
+  stop_bus_offsets_ = {};
+  stop_buses_ = {};
+  loaded_ = false;
+  return tables;
+}
+
+void BusManager::Restore(const FrozenNetwork& network) {
+  if (names_.Size() != 0 || !stops_.empty()) {
+    throw std::logic_error("Network is restored into an empty manager only");
+  }
+  const NamePool& names = network.GetNames();
+  for (NameId name = 0; name < names.Size(); ++name) {
+    names_.Intern(names.Get(name));
+  }
+
+  for (StopId stop = 0; stop < network.GetStopCount(); ++stop) {
+    const StopId id = GetOrCreateStop(network.GetStopName(stop));
+    stops_[id].SetCoordinates(network.GetStopCoordinates(stop));
+  }
+  network.GetDistances().ForEach([this](StopId from, StopId to, size_t meters) {
+    distances_.Set(from, to, meters);
+  });
+
+  for (const FrozenBus& bus : network.GetBuses()) {
+    auto record = std::make_shared<BusRecord>(bus.type, names_.Get(bus.name));
+    for (StopId stop : network.GetBusStops(bus)) {
+      record->AddStop(stop);
+    }
+    AddRecord(bus_index_, bus.name, std::move(record));
+  }
+
+  for (const auto& trip : network.GetTrips()) {
+    trips_.push_back({names_.Get(names_.Intern(trip.bus)), trip.times});
+  }
+}
+
+std::span<const NameId> BusManager::GetStopBuses(StopId id) const {
+  if (stop_bus_offsets_.size() != stops_.size() + 1) {
+    throw std::logic_error("Stop buses are built by FinishLoading");
+  }
+  const uint32_t end = stop_bus_offsets_.at(id + 1);
+  const uint32_t begin = stop_bus_offsets_[id];
+  return {stop_buses_.data() + begin, end - begin};
+}
+
+StopId BusManager::CreateStop(NameId name) {
+  const auto id = static_cast<StopId>(stops_.size());
+  stops_.emplace_back(names_.Get(name), id);
+  AddRecord(stop_index_, name, id);
+  return id;
+}
+
+StopId BusManager::GetOrCreateStop(std::string_view name) {
+  const NameId name_id = names_.Intern(name);
+  auto result = GetRecord(stop_index_, name_id);
+  if (!result) {
+    return CreateStop(name_id);
+  }
+  return *result;
 }
 
 std::optional<const std::reference_wrapper<BusRecord>> BusManager::GetBus(
-    const std::string& name) const {
+    std::string_view name) const {
   auto record = GetRecord(bus_index_, name);
   if (!record.has_value()) {
     //throw std::runtime_error("bad database access! Bus not found with name " +
@@ -170,15 +356,49 @@ std::optional<const std::reference_wrapper<BusRecord>> BusManager::GetBus(
   return *(record.value());
 }
 
-std::optional<const std::reference_wrapper<StopRecord>> BusManager::GetStop(
-    const std::string& name) const {
+std::optional<const std::reference_wrapper<const StopRecord>> BusManager::GetStop(
+    std::string_view name) const {
   auto record = GetRecord(stop_index_, name);
   if (!record.has_value()) {
     //throw std::runtime_error("bad database access! Stop not found with name " +
     //                         name);
     return std::nullopt;
   }
-  return *(record.value());
+  return stops_[record.value()];
+}
+
+std::vector<const BusRecord*> BusManager::GetBusRecords() const {
+  std::vector<const BusRecord*> buses;
+  for (const auto& record_ptr : bus_index_) {
+    if (record_ptr) {
+      buses.push_back(record_ptr->get());
+    }
+  }
+  return buses;
+}
+
+size_t BusManager::GetStopCount() const noexcept {
+  return stops_.size();
+}
+
+const StopArena& BusManager::GetStops() const noexcept {
+  return stops_;
+}
+
+const RoadDistanceTable& BusManager::GetDistances() const noexcept {
+  return distances_;
+}
+
+const std::vector<TripRecord>& BusManager::GetTrips() const noexcept {
+  return trips_;
+}
+
+const StopRecord& BusManager::GetStopById(size_t id) const {
+  return stops_.at(id);
+}
+
+const NamePool& BusManager::GetNames() const noexcept {
+  return names_;
 }
 
 double GradToRad(double value) noexcept {
@@ -192,7 +412,12 @@ double HaversineDistance(const Coordinates& start, const Coordinates& finish) {
   double long1 = GradToRad(start.longitude);
   double long2 = GradToRad(finish.longitude);
   using namespace std;
-  return acos(sin(lat1) * sin(lat2) + cos(lat1) * cos(lat2) * cos(abs(long1 - long2))) * 6371000;
+  // sin((b - a) / 2) over half angles, the same operations as
+  // CoordinateTable does, no cancellation for close stops
+  const double sin_dlat = sin(lat2 / 2) * cos(lat1 / 2) - cos(lat2 / 2) * sin(lat1 / 2);
+  const double sin_dlon = sin(long2 / 2) * cos(long1 / 2) - cos(long2 / 2) * sin(long1 / 2);
+  const double h = sin_dlat * sin_dlat + cos(lat1) * cos(lat2) * sin_dlon * sin_dlon;
+  return 2 * asin(sqrt(min(h, 1.0))) * 6371000;
 }
 
 }  // namespace bus
\ No newline at end of file
@@ -3,26 +3,31 @@
 #include <string_view>
 #include <unordered_map>
 #include <vector>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <cmath>
 #include <functional>
 #include <type_traits>
-#include <set>
+#include <span>
 #include "utility/utility.h"
+#include "NamePool.h"
+#include "RoadDistances.h"
 
 
 namespace bus {
 
 class StopRecord;
 class BusRecord;
+class CoordinateTable;
+class FrozenNetwork;
+struct NetworkTables;
 
-using StopRecordPtr = std::shared_ptr<StopRecord>;
 using BusRecordPtr = std::shared_ptr<BusRecord>;
-using StopRecordWeakPtr = std::weak_ptr<StopRecord>;
-using BusRecordWeakPtr = std::weak_ptr<BusRecord>;
 
-static size_t CURRENT_STOP_ID = 0;
+// Stops live in an arena owned by BusManager and are referred to by index.
+// Deque keeps names in place while stops are added, indexes keep views to them
+using StopArena = std::deque<StopRecord>;
 
 struct Coordinates {
  public:
@@ -30,21 +35,34 @@ struct Coordinates {
   double longitude{0};
 };
 
+// Bus figures which do not change after loading
+struct BusStats {
+  double route_length{0};
+  double geom_length{0};
+  size_t unique_stops{0};
+  size_t stops_on_route{0};
+};
+
 class BusRecord {
  public:
   enum class RouteType { Circular, Linear };
 
-  explicit BusRecord(RouteType type, std::string name);
+  // Name is not copied, BusManager keeps it in its name pool
+  explicit BusRecord(RouteType type, std::string_view name);
 
-  void AddStop(StopRecordPtr ptr);
+  void AddStop(StopId id);
 
-  [[nodiscard]] auto GetStops() const -> const std::vector<StopRecordWeakPtr>&;
+  [[nodiscard]] auto GetStops() const -> const std::vector<StopId>&;
 
   [[nodiscard]] const std::string_view GetName() const noexcept;
 
-  [[nodiscard]] double GetGeomLength() const;
+  [[nodiscard]] double GetGeomLength(const StopArena& stops) const;
+
+  // Same value computed in one batch over the coordinate table
+  [[nodiscard]] double GetGeomLength(const CoordinateTable& coordinates) const;
 
-  [[nodiscard]] double GetRouteLength() const;
+  [[nodiscard]] double GetRouteLength(const StopArena& stops,
+                                      const RoadDistanceTable& distances) const;
 
   [[nodiscard]] RouteType GetType() const;
 
@@ -52,176 +70,233 @@ class BusRecord {
 
   [[nodiscard]] size_t GetStopsOnRoute() const;
 
+  // Stores stats so that later GetStats calls do not touch the stops
+  void PrecomputeStats(const CoordinateTable& coordinates, const StopArena& stops,
+                       const RoadDistanceTable& distances);
+
+  [[nodiscard]] BusStats GetStats(const StopArena& stops,
+                                  const RoadDistanceTable& distances) const;
+
  private:
-  std::string name_;
-  std::vector<StopRecordWeakPtr> stops_;
+  std::string_view name_;
+  std::vector<StopId> stops_;
   RouteType type_;
+  std::optional<BusStats> stats_;
 };
 
 
 
 class StopRecord {
  public:
-  StopRecord(std::string name);
-  StopRecord(std::string name, Coordinates place);
+  // Name is not copied, BusManager keeps it in its name pool
+  StopRecord(std::string_view name);
+  StopRecord(std::string_view name, Coordinates place);
+  StopRecord(std::string_view name, StopId id);
 
   void SetCoordinates(Coordinates place);
 
   const Coordinates& GetCoordinates() const noexcept;
 
-  void AddBus(std::string_view);
-
-  void SetDist(std::string_view name, size_t dist);
-
   [[nodiscard]] const std::string_view GetName() const noexcept;
 
-  [[nodiscard]] const std::set<std::string_view>& GetBuses() const noexcept;
-
-  [[nodiscard]] std::optional<size_t> GetDist(
-      std::string_view finish) const noexcept;
+  // Dense id assigned by BusManager in order of creation
+  [[nodiscard]] StopId GetId() const noexcept;
 
-  [[nodiscard]] bool IsInitialized() {
+  [[nodiscard]] bool IsInitialized() const {
     return initialized_;
   }
 
  private:
-  //size_t stop_id_ = CURRENT_STOP_ID++;
+  StopId id_{0};
   Coordinates place_;
-  std::string name_;
+  std::string_view name_;
   bool initialized_{false};
-  std::set<std::string_view> buses_;
-  std::unordered_map<std::string_view, size_t> distances_;
 };
 
 
 
+// Single run of a bus: minutes at every stop it passes, for linear
+// routes including the way back
+struct TripRecord {
+  std::string_view bus;
+  std::vector<double> times;
+};
+
 class BusManager {
  public:
+  virtual ~BusManager() = default;
+
   void AddBus(const std::string& name, const std::vector<std::string>& stops,
               BusRecord::RouteType type);
 
   void AddStop(const std::string& name, const Coordinates& pos,
                const std::vector<std::pair<std::string, size_t>>& dist = {});
 
-  auto GetBus(const std::string& name) const
+  void AddTrip(const std::string& bus, const std::vector<double>& times);
+
+  // Computes stats of all buses in parallel, call when loading is finished
+  void PrecomputeBusStats();
+
+  // Freezes road distances and names and precomputes stats, stops and buses
+  // cannot be added after. Calls after the first one do nothing
+  void FinishLoading();
+
+  // Moves loaded data into a read-only network, the manager is left empty
+  virtual std::shared_ptr<const FrozenNetwork> Freeze();
+
+  // Loads stops, buses, distances and trips of the network back, so that
+  // more can be added before the next Freeze. Names and stops keep their
+  // ids. Throws std::logic_error if the manager is not empty
+  void Restore(const FrozenNetwork& network);
+
+  auto GetBus(std::string_view name) const
       -> std::optional<const std::reference_wrapper<BusRecord>>;
 
-  auto GetStop(const std::string& name) const
-      -> std::optional<const std::reference_wrapper<StopRecord>>;
+  auto GetStop(std::string_view name) const
+      -> std::optional<const std::reference_wrapper<const StopRecord>>;
+
+  [[nodiscard]] size_t GetStopCount() const noexcept;
+
+  [[nodiscard]] const StopArena& GetStops() const noexcept;
+
+  [[nodiscard]] const RoadDistanceTable& GetDistances() const noexcept;
+
+  [[nodiscard]] const std::vector<TripRecord>& GetTrips() const noexcept;
+
+  [[nodiscard]] const StopRecord& GetStopById(size_t id) const;
+
+  [[nodiscard]] const NamePool& GetNames() const noexcept;
+
+  // Buses passing the stop in order of their names. Throws std::logic_error
+  // before FinishLoading
+  [[nodiscard]] std::span<const NameId> GetStopBuses(StopId id) const;
 
  protected:
+  // Records by id of their name in the pool, names of other kind are empty
   template <typename T>
-  using Index = std::unordered_map<std::string_view, T>;
+  using Index = std::vector<std::optional<T>>;
 
-  using StopIndex = Index<StopRecordPtr>;
+  using StopIndex = Index<StopId>;
   using BusIndex = Index<BusRecordPtr>;
 
-  template <typename RecordPtr, typename IndexType>
-  void AddRecord(Index<IndexType>& index,
-                 RecordPtr record) {
-    auto& underlying = *record;
-    index.insert({underlying.GetName(), record});
+  // Keeps the first record added under the name
+  template <typename IndexType>
+  void AddRecord(Index<IndexType>& index, NameId name, IndexType record) {
+    if (index.size() <= name) {
+      index.resize(names_.Size());
+    }
+    if (!index[name]) {
+      index[name] = std::move(record);
+    }
   }
 
   template <typename IndexType>
-  [[nodiscard]] auto GetRecord(const Index<IndexType>& index, std::string_view name) const -> std::optional<IndexType> {
-    auto result = index.find(name);
-    if (result == index.end()) {
+  [[nodiscard]] auto GetRecord(const Index<IndexType>& index, NameId name) const -> std::optional<IndexType> {
+    if (name >= index.size()) {
       return std::nullopt;
     }
-    return (*result).second;
+    return index[name];
   }
 
   template <typename IndexType>
-  [[nodiscard]] IndexType GetOrCreateRecord(Index<IndexType>& index,
-                                            std::string_view name) {
-    auto result = index.find(name);
-    if (result == index.end()) {
-      auto record = std::make_shared<std::decay_t<decltype(*(std::declval<IndexType>()))>>(std::string(name));
-      AddRecord(index, record);
-      return record;
+  [[nodiscard]] auto GetRecord(const Index<IndexType>& index, std::string_view name) const -> std::optional<IndexType> {
+    auto id = names_.Find(name);
+    if (!id) {
+      return std::nullopt;
     }
-    return (*result).second;
+    return GetRecord(index, *id);
   }
 
+  // Bus records in index order
+  [[nodiscard]] std::vector<const BusRecord*> GetBusRecords() const;
+
+  // Creates stop record at the end of the arena and registers it in the index
+  StopId CreateStop(NameId name);
+
+  [[nodiscard]] StopId GetOrCreateStop(std::string_view name);
+
+  // Lays out buses of every stop in one array sorted by stop and bus name
+  void BuildStopBuses();
+
+  // Finishes loading and hands over data to the network tables
+  [[nodiscard]] NetworkTables TakeTables();
+
 
  protected:
+  // Declared first, records keep views to the pool
+  NamePool names_;
   StopIndex stop_index_;
   BusIndex bus_index_;
+  StopArena stops_;
+  RoadDistanceTable distances_;
+  // Buses of stop s are stop_buses_[stop_bus_offsets_[s]..stop_bus_offsets_[s + 1])
+  std::vector<uint32_t> stop_bus_offsets_;
+  std::vector<NameId> stop_buses_;
+  // Trips may come before their bus, so they are resolved when routing is built
+  std::vector<TripRecord> trips_;
+  bool loaded_ = false;
 };
 
 double GradToRad(double value) noexcept;
 
 //---------------------------------------------------------
 
+// Great-circle distance in metres by the haversine formula, 2 R asin(sqrt(h))
+// with h clamped to 1, precise for stops centimetres apart as well
 double HaversineDistance(const Coordinates& start,
                          const Coordinates& finish);
 
-template <typename U>
-inline double HaversineDistance(const std::weak_ptr<U> start,
-                                const std::weak_ptr<U> finish) {
-  return HaversineDistance(start.lock()->GetCoordinates(),
-                           finish.lock()->GetCoordinates());
-}
-
 inline double HaversineDistance(const StopRecord& start,
                                 const StopRecord& finish) {
   return HaversineDistance(start.GetCoordinates(),
                            finish.GetCoordinates());
 }
 
-//--------------------------------------------------------------
-
-template <typename U>
-inline double RouteDistance(const std::weak_ptr<U> start,
-                                const std::weak_ptr<U> finish) {
-  auto from = start.lock();
-  auto to = finish.lock();
-  auto distance = from->GetDist(to->GetName());
-  if (distance) {
-    return *distance;
-  } else {
-    return HaversineDistance(from->GetCoordinates(), to->GetCoordinates());
-  }
+inline double HaversineDistance(const StopArena& stops, StopId start,
+                                StopId finish) {
+  return HaversineDistance(stops[start], stops[finish]);
 }
 
+//--------------------------------------------------------------
 
-inline double RouteDistance(const StopRecord& start,
-                                const StopRecord& finish) {
-  auto distance = start.GetDist(finish.GetName());
+inline double RouteDistance(const StopArena& stops,
+                            const RoadDistanceTable& distances, StopId start,
+                            StopId finish) {
+  auto distance = distances.Get(start, finish);
   if (distance) {
     return *distance;
   } else {
-    return HaversineDistance(start.GetCoordinates(), finish.GetCoordinates());
+    return HaversineDistance(stops, start, finish);
   }
 }
 
 //-------------------------------------------------------------------------
 
-
-template <typename InputIt>
-double CalculateLength(InputIt first, InputIt last) {
+// Items of the range are either points or stop ids resolved via stops
+// (and road distances for route length)
+template <typename InputIt, typename... Arena>
+double CalculateLength(InputIt first, InputIt last, const Arena&... stops) {
   double length = 0;
   auto prev = first;
   if (prev == last) {
     return length;
   }
   for (auto it = ++first; it != last; ++it) {
-    length += HaversineDistance(*prev, *it);
+    length += HaversineDistance(stops..., *prev, *it);
     prev = it;
   }
   return length;
 }
 
-template <typename InputIt>
-double CalculateRouteLength(InputIt first, InputIt last) {
+template <typename InputIt, typename... Arena>
+double CalculateRouteLength(InputIt first, InputIt last, const Arena&... stops) {
   double length = 0;
   auto prev = first;
   if (prev == last) {
     return length;
   }
   for (auto it = ++first; it != last; ++it) {
-    length += RouteDistance(*prev, *it);
+    length += RouteDistance(stops..., *prev, *it);
     prev = it;
   }
   return length;
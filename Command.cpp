@@ -1,4 +1,5 @@
 #include "Command.h"
+#include <iterator>
 
 void AddBusRequest::ParseFrom(std::string_view input) {
   auto [lhs, rhs] = SplitTwo(input, ":");
@@ -27,7 +28,7 @@ void AddBusRequest::Process(bus::BusManager& manager) const {
 }
 
 
-void AddBusRequest::ParseFromJson(const Json::Node& node) {
+void AddBusRequest::ParseFromJson(const Json::Value& node) {
 
   const auto& dict = node.AsMap();
   name_ = dict.at("name").AsString();
@@ -35,7 +36,7 @@ void AddBusRequest::ParseFromJson(const Json::Node& node) {
                                            : bus::BusRecord::RouteType::Linear;
   const auto& stops = dict.at("stops").AsArray();
   for (const auto& node : stops) {
-    stops_.push_back(node.AsString());
+    stops_.emplace_back(node.AsString());
   }
 }
 
@@ -62,7 +63,7 @@ void AddStopRequest::Process(bus::BusManager& manager) const {
 }
 
 
-void AddStopRequest::ParseFromJson(const Json::Node& node) {
+void AddStopRequest::ParseFromJson(const Json::Value& node) {
   const auto& dict = node.AsMap();
   name_ = dict.at("name").AsString();
   pos_.latitude = dict.at("latitude").AsDouble();
@@ -70,11 +71,37 @@ void AddStopRequest::ParseFromJson(const Json::Node& node) {
 
   const auto& distances = dict.at("road_distances").AsMap();
   for (const auto& [stop, node] : distances) {
-    distances_.push_back({stop, node.AsDouble()});
+    distances_.emplace_back(stop, node.AsIntegral());
   }
 }
 
 
+//-------------------------------------------------------------------
+
+// Trip 750: 0, 4, 10, 16, 20
+void AddTripRequest::ParseFrom(std::string_view input) {
+  auto [lhs, rhs] = SplitTwo(input, ": ");
+  bus_ = SplitTwo(lhs).second;
+
+  while (rhs.size() != 0) {
+    times_.push_back(ConvertToNum<double>(ReadToken(rhs, ", ")));
+  }
+}
+
+void AddTripRequest::Process(bus::BusManager& manager) const {
+  manager.AddTrip(bus_, times_);
+}
+
+void AddTripRequest::ParseFromJson(const Json::Value& node) {
+  const auto& dict = node.AsMap();
+  bus_ = dict.at("bus").AsString();
+  const auto& times = dict.at("times").AsArray();
+  times_.reserve(times.size());
+  for (const auto& node : times) {
+    times_.push_back(node.AsDouble());
+  }
+}
+
 //-----------------------------------------------------------------
 
 void GetBusInfoRequest::ParseFrom(std::string_view input) {
@@ -83,16 +110,16 @@ void GetBusInfoRequest::ParseFrom(std::string_view input) {
 }
 
 
-void GetBusInfoRequest::ParseFromJson(const Json::Node& node) {
+void GetBusInfoRequest::ParseFromJson(const Json::Value& node) {
   const auto& dict = node.AsMap();
   name_ = dict.at("name").AsString();
-  request_id_ = static_cast<size_t>(dict.at("id").AsDouble());
+  request_id_ = dict.at("id").AsInt();
 }
 
 
 BusInfo GetBusInfoRequest::Process(
-    const bus::BusManager& manager) const {
-  auto maybe_record = manager.GetBus(name_);
+    const bus::FrozenNetwork& network) const {
+  auto maybe_record = network.FindBus(name_);
   BusInfo answer;
   answer.request_id_ = request_id_;
   if (!maybe_record) {
@@ -100,11 +127,11 @@ BusInfo GetBusInfoRequest::Process(
     return answer;
   }
 
-  const auto& info = maybe_record.value().get();
-  answer.route_length_ = info.GetRouteLength();
-  answer.stops_on_route_ = info.GetStopsOnRoute();
-  answer.unique_stops = info.GetUniqueStops();
-  answer.curvature_ = answer.route_length_ / info.GetGeomLength();
+  const auto& stats = maybe_record.value().get().stats;
+  answer.route_length_ = stats.route_length;
+  answer.stops_on_route_ = stats.stops_on_route;
+  answer.unique_stops = stats.unique_stops;
+  answer.curvature_ = stats.route_length / stats.geom_length;
   return answer;
 }
 
@@ -126,13 +153,13 @@ std::ostream& operator<<(std::ostream& out, const StopInfo& info) {
     out << bus::NUM_TO_ERROR.find(info.error_code_)->second;
     return out;
   }
-  const auto& buses = *info.buses_.value();
+  const auto buses = info.buses_.value();
   if (buses.empty()) {
     out << "no buses";
   } else {
     out << "buses";
-    for (const auto& bus : buses) {
-      out << " " << bus;
+    for (bus::NameId bus : buses) {
+      out << " " << info.names_->Get(bus);
     }
   }
   return out;
@@ -144,12 +171,20 @@ Request::RequestHolder Request::Create(Request::Type type) {
       return std::make_unique<AddBusRequest>();
     case Request::Type::ADD_STOP:
       return std::make_unique<AddStopRequest>();
+    case Request::Type::ADD_TRIP:
+      return std::make_unique<AddTripRequest>();
     case Request::Type::GET_BUS:
       return std::make_unique<GetBusInfoRequest>();
     case Request::Type::GET_STOP:
       return std::make_unique<GetStopInfoRequest>();
     case Request::Type::GET_ROUTE:
       return std::make_unique<GetRouteInfoRequest>();
+    case Request::Type::GET_ROUTE_VIA:
+      return std::make_unique<GetRouteViaInfoRequest>();
+    case Request::Type::GET_NEAREST_STOPS:
+      return std::make_unique<GetNearestStopsRequest>();
+    case Request::Type::SEARCH_STOPS:
+      return std::make_unique<StopSearchRequest>();
     default:
       return nullptr;
   }
@@ -164,24 +199,24 @@ void GetStopInfoRequest::ParseFrom(std::string_view input) {
 }
 
 
-void GetStopInfoRequest::ParseFromJson(const Json::Node& node) {
+void GetStopInfoRequest::ParseFromJson(const Json::Value& node) {
   const auto& dict = node.AsMap();
   name_ = dict.at("name").AsString();
-  request_id_ = static_cast<size_t>(dict.at("id").AsDouble());
+  request_id_ = dict.at("id").AsInt();
 }
 
 
 StopInfo GetStopInfoRequest::Process(
-    const bus::BusManager& manager) const {
-  auto maybe_record = manager.GetStop(name_);
+    const bus::FrozenNetwork& network) const {
+  auto maybe_stop = network.FindStop(name_);
   StopInfo answer;
   answer.request_id_ = request_id_;
-  if (!maybe_record) {
+  if (!maybe_stop) {
     answer.error_code_ = bus::kErrorNotFound;
     return answer;
   }
-  const auto& info = maybe_record.value().get();
-  answer.buses_ = std::addressof(info.GetBuses());
+  answer.buses_ = network.GetStopBuses(*maybe_stop);
+  answer.names_ = std::addressof(network.GetNames());
   return answer;
 }
 
@@ -189,11 +224,17 @@ StopInfo GetStopInfoRequest::Process(
 //GetRouteInfoRequest
 
 
-void GetRouteInfoRequest::ParseFromJson(const Json::Node& node) {
+void GetRouteInfoRequest::ParseFromJson(const Json::Value& node) {
   const auto& dict = node.AsMap();
   from_ = dict.at("from").AsString();
   to_ = dict.at("to").AsString();
-  request_id_ = static_cast<size_t>(dict.at("id").AsDouble());
+  request_id_ = dict.at("id").AsInt();
+  if (auto it = dict.find("min_transfers"); it != dict.end()) {
+    min_transfers_ = it->second.AsBool();
+  }
+  if (auto it = dict.find("departure_time"); it != dict.end()) {
+    departure_time_ = it->second.AsDouble();
+  }
 }
 
 void GetRouteInfoRequest::ParseFrom(std::string_view input) {
@@ -202,33 +243,221 @@ void GetRouteInfoRequest::ParseFrom(std::string_view input) {
 }
 
 
-RouteInfo GetRouteInfoRequest::Process(const bus::BusManager& manager) const {
-  const auto& router = static_cast<const bus::BusManagerWithRouter&>(manager);
-  auto maybe_info = router.GetRoute(from_, to_);
+RouteInfo GetRouteInfoRequest::Process(const bus::FrozenNetwork& network) const {
   RouteInfo answer;
   answer.request_id_ = request_id_;
 
+  auto maybe_info =
+      FindRouteItems(network, from_, to_, min_transfers_, departure_time_);
   if (!maybe_info) {
     answer.error_code_ = bus::kErrorNotFound;
     return answer;
   }
 
-  RouteInterpreter interpreter{router};
-  auto info = interpreter.InterpretRoute(*maybe_info);
-  answer.route_items_ = std::move(info.first);
-  answer.total_time_ = info.second;
+  answer.route_items_ = std::move(maybe_info->first);
+  answer.total_time_ = maybe_info->second;
+
+  return answer;
+}
+
+//-------------------------------------------------
+//GetRouteViaInfoRequest
+
+void GetRouteViaInfoRequest::ParseFromJson(const Json::Value& node) {
+  const auto& dict = node.AsMap();
+  const auto& stops = dict.at("stops").AsArray();
+  stops_.reserve(stops.size());
+  for (const auto& stop : stops) {
+    stops_.emplace_back(stop.AsString());
+  }
+  request_id_ = dict.at("id").AsInt();
+  if (auto it = dict.find("min_transfers"); it != dict.end()) {
+    min_transfers_ = it->second.AsBool();
+  }
+  if (auto it = dict.find("departure_time"); it != dict.end()) {
+    departure_time_ = it->second.AsDouble();
+  }
+}
+
+// RouteVia Biryusinka > Universam > Prazhskaya
+void GetRouteViaInfoRequest::ParseFrom(std::string_view input) {
+  auto rhs = SplitTwo(input).second;
+  std::string_view token;
+  while ((token = ReadToken(rhs, " > ")) != "") {
+    stops_.push_back(std::string(token));
+  }
+}
+
+RouteInfo GetRouteViaInfoRequest::Process(
+    const bus::FrozenNetwork& network) const {
+  RouteInfo answer;
+  answer.request_id_ = request_id_;
+
+  // Every waypoint has to exist, even a single one
+  std::vector<bus::StopId> stop_ids;
+  stop_ids.reserve(stops_.size());
+  for (const auto& stop : stops_) {
+    auto id = network.FindStop(stop);
+    if (!id) {
+      answer.error_code_ = bus::kErrorNotFound;
+      return answer;
+    }
+    stop_ids.push_back(*id);
+  }
+  if (stop_ids.empty()) {
+    answer.error_code_ = bus::kErrorNotFound;
+    return answer;
+  }
+
+  // Every waypoint is the target of one leg and the source of the next,
+  // with timetables the next leg starts when the previous one arrives
+  for (size_t i = 0; i + 1 < stop_ids.size(); ++i) {
+    auto maybe_leg =
+        FindRouteItems(network, stop_ids[i], stop_ids[i + 1], min_transfers_,
+                       departure_time_ + answer.total_time_);
+    if (!maybe_leg) {
+      answer.route_items_.clear();
+      answer.total_time_ = 0;
+      answer.error_code_ = bus::kErrorNotFound;
+      return answer;
+    }
+    std::move(maybe_leg->first.begin(), maybe_leg->first.end(),
+              std::back_inserter(answer.route_items_));
+    answer.total_time_ += maybe_leg->second;
+  }
 
   return answer;
 }
 
+//-------------------------------------------------
+//GetNearestStopsRequest
+
+void GetNearestStopsRequest::ParseFromJson(const Json::Value& node) {
+  const auto& dict = node.AsMap();
+  place_.latitude = dict.at("latitude").AsDouble();
+  place_.longitude = dict.at("longitude").AsDouble();
+  count_ = dict.at("count").AsInt();
+  request_id_ = dict.at("id").AsInt();
+  if (auto it = dict.find("radius"); it != dict.end()) {
+    radius_ = it->second.AsDouble();
+  }
+}
+
+// NearestStops 55.611087, 37.20829, 3, 1500m with the radius optional
+void GetNearestStopsRequest::ParseFrom(std::string_view input) {
+  auto rhs = SplitTwo(input).second;
+  auto latitude = ReadToken(rhs, ", ");
+  auto longitude = ReadToken(rhs, ", ");
+  place_ = {ConvertToNum<double>(latitude), ConvertToNum<double>(longitude)};
+  count_ = ConvertToNum<size_t>(ReadToken(rhs, ", "));
+  if (rhs.size() != 0) {
+    radius_ = ConvertToNum<double>(SplitTwo(rhs, "m").first);
+  }
+}
+
+NearestStopsInfo GetNearestStopsRequest::Process(
+    const bus::FrozenNetwork& network) const {
+  NearestStopsInfo answer;
+  answer.request_id_ = request_id_;
+  for (const auto& [stop, distance] :
+       network.FindNearestStops(place_, count_, radius_)) {
+    answer.stops_.emplace_back(network.GetStopName(stop), distance);
+  }
+  return answer;
+}
+
+//-------------------------------------------------
+//StopSearchRequest
+
+// More edits than query characters match every name, so the fuzzy search
+// would degrade into a full scan of the index
+static uint32_t CheckedMaxEdits(size_t max_edits, std::string_view query) {
+  if (max_edits > query.size()) {
+    throw std::runtime_error("max_edits exceeds the query length");
+  }
+  return static_cast<uint32_t>(max_edits);
+}
+
+void StopSearchRequest::ParseFromJson(const Json::Value& node) {
+  const auto& dict = node.AsMap();
+  query_ = dict.at("query").AsString();
+  count_ = dict.at("count").AsInt();
+  request_id_ = dict.at("id").AsInt();
+  if (auto it = dict.find("max_edits"); it != dict.end()) {
+    max_edits_ = CheckedMaxEdits(it->second.AsIntegral(), query_);
+  }
+}
+
+// StopSearch 5, 1 edits: Universam with the edits optional
+void StopSearchRequest::ParseFrom(std::string_view input) {
+  auto [lhs, rhs] = SplitTwo(input, ": ");
+  query_ = std::string(rhs);
+  auto params = SplitTwo(lhs).second;
+  count_ = ConvertToNum<size_t>(ReadToken(params, ", "));
+  if (params.size() != 0) {
+    max_edits_ =
+        CheckedMaxEdits(ConvertToNum<size_t>(SplitTwo(params).first), query_);
+  }
+}
+
+StopSearchInfo StopSearchRequest::Process(
+    const bus::FrozenNetwork& network) const {
+  StopSearchInfo answer;
+  answer.request_id_ = request_id_;
+  for (const auto& match : network.SearchStops(query_, count_, max_edits_)) {
+    answer.stops_.push_back(network.GetStopName(match.stop));
+  }
+  return answer;
+}
+
+std::optional<std::pair<std::vector<RouteInfo::RouteItemVar>, double>>
+FindRouteItems(const bus::FrozenNetwork& network, std::string_view from,
+               std::string_view to, bool min_transfers,
+               double departure_time) {
+  auto start = network.FindStop(from);
+  auto end = network.FindStop(to);
+  if (!start || !end) {
+    return std::nullopt;
+  }
+  return FindRouteItems(network, *start, *end, min_transfers, departure_time);
+}
+
+std::optional<std::pair<std::vector<RouteInfo::RouteItemVar>, double>>
+FindRouteItems(const bus::FrozenNetwork& network, bus::StopId from,
+               bus::StopId to, bool min_transfers, double departure_time) {
+  const auto algorithm = network.GetRoutingAlgorithm();
+  if (algorithm == bus::RoutingAlgorithm::TIMETABLE || min_transfers ||
+      algorithm == bus::RoutingAlgorithm::RAPTOR) {
+    using Criterion = bus::RaptorRouter::Criterion;
+    auto maybe_journey =
+        algorithm == bus::RoutingAlgorithm::TIMETABLE
+            ? network.GetTimetableRoute(from, to, departure_time)
+            : network.GetRaptorRoute(from, to,
+                                     min_transfers ? Criterion::MIN_TRANSFERS
+                                                   : Criterion::FASTEST);
+    if (!maybe_journey) {
+      return std::nullopt;
+    }
+    return InterpretJourney(network, *maybe_journey);
+  }
+
+  auto maybe_route = network.GetRoute(from, to);
+  if (!maybe_route) {
+    return std::nullopt;
+  }
+
+  RouteInterpreter interpreter{network};
+  return interpreter.InterpretRoute(*maybe_route);
+}
+
 std::pair<std::vector<RouteInfo::RouteItemVar>, double>
-RouteInterpreter::InterpretRoute(const Router::RouteInfo& info) const {
+RouteInterpreter::InterpretRoute(const bus::GraphRoute& route) const {
   using Item = RouteInfo::RouteItemVar;
   std::vector<RouteInfo::RouteItemVar> route_info;
-  double total_time = info.weight.time;
+  double total_time = route.weight.time;
 
-  for (size_t i = 0; i < info.edge_count; ++i) {
-    auto maybe_item = GetItem(info.id, i);
+  for (auto edge_id : route.edges) {
+    auto maybe_item = GetItem(edge_id);
     if (maybe_item) {
       route_info.push_back(std::move(*maybe_item));
     }
@@ -237,24 +466,37 @@ RouteInterpreter::InterpretRoute(const Router::RouteInfo& info) const {
 }
 
 std::optional<RouteInfo::RouteItemVar> RouteInterpreter::GetItem(
-    Router::RouteId id, size_t current_edge_num) const {
+    ::Graph::EdgeId edge_id) const {
   using Item = RouteInfo::RouteItemVar;
-  auto edge_id = router_.GetRouteEdge(id, current_edge_num);
   const auto& edge = graph_.GetEdge(edge_id);
 
-  auto [stop, route] = manager_.GetStopFromIndex(edge.from).value();
+  auto [stop, route] = network_.GetStopFromIndex(edge.from).value();
   if (route == bus::NodeType::WAIT) {
     double time = edge.weight.time;
-    Item item = WaitRouteItem{std::string(stop), time};
+    Item item = WaitRouteItem{stop, time};
 
     return item;
 
   } else {
-    std::string current_route = std::string(edge.weight.route);
     uint32_t span_count = edge.weight.span;
     double time = edge.weight.time;
 
-    Item item = BusRouteItem{std::move(current_route), time, span_count};
+    Item item = BusRouteItem{network_.GetNames().Get(edge.weight.route), time,
+                             span_count};
     return item;
   }
 }
+
+std::pair<std::vector<RouteInfo::RouteItemVar>, double> InterpretJourney(
+    const bus::FrozenNetwork& network, const bus::Journey& journey) {
+  std::vector<RouteInfo::RouteItemVar> route_info;
+  route_info.reserve(journey.legs.size() * 2);
+
+  for (const auto& leg : journey.legs) {
+    route_info.push_back(WaitRouteItem{
+        network.GetStopName(static_cast<bus::StopId>(leg.board_stop)),
+        leg.wait_time});
+    route_info.push_back(BusRouteItem{leg.bus, leg.ride_time, leg.span});
+  }
+  return {std::move(route_info), journey.total_time};
+}
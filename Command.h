@@ -1,50 +1,61 @@
 #pragma once
 #include "BusManager.h"
 #include "StopsGraphManager.h"
+#include "FrozenNetwork.h"
 #include "Parcing/Parcing.h"
 #include "Json/json.h"
 
+#include <limits>
+
 struct Request {
   using RequestHolder = std::unique_ptr<Request>;
 
   enum class Type {
     ADD_STOP,
     ADD_BUS,
+    ADD_TRIP,
     GET_BUS,
     GET_STOP,
-    GET_ROUTE
+    GET_ROUTE,
+    GET_ROUTE_VIA,
+    GET_NEAREST_STOPS,
+    SEARCH_STOPS
   };
 
 
   Request(Type type) : type_(type) {};
   static RequestHolder Create(Type type);
   virtual void ParseFrom(std::string_view input) = 0;
-  virtual void ParseFromJson(const Json::Node& node) = 0;
+  virtual void ParseFromJson(const Json::Value& node) = 0;
   virtual ~Request() = default;
 
   const Type type_;
 };
 
 const std::unordered_map<std::string_view, Request::Type>
-    STR_TO_MOD_REQUEST_TYPE = {{"Bus", Request::Type::ADD_BUS}, {"Stop", Request::Type::ADD_STOP}};
+    STR_TO_MOD_REQUEST_TYPE = {{"Bus", Request::Type::ADD_BUS}, {"Stop", Request::Type::ADD_STOP}, {"Trip", Request::Type::ADD_TRIP}};
 
 const std::unordered_map<std::string_view, Request::Type>
     STR_TO_READ_REQUEST_TYPE = {
-        {"Bus", Request::Type::GET_BUS}, {"Stop", Request::Type::GET_STOP}, {"Route", Request::Type::GET_ROUTE}};
+        {"Bus", Request::Type::GET_BUS}, {"Stop", Request::Type::GET_STOP}, {"Route", Request::Type::GET_ROUTE},
+        {"RouteVia", Request::Type::GET_ROUTE_VIA}, {"NearestStops", Request::Type::GET_NEAREST_STOPS},
+        {"StopSearch", Request::Type::SEARCH_STOPS}};
 
 const std::unordered_map<Request::Type, std::string_view>
-    MOD_REQUEST_TYPE_TO_STR = {{Request::Type::ADD_BUS, "Bus"}, {Request::Type::ADD_STOP, "Stop"}};
+    MOD_REQUEST_TYPE_TO_STR = {{Request::Type::ADD_BUS, "Bus"}, {Request::Type::ADD_STOP, "Stop"}, {Request::Type::ADD_TRIP, "Trip"}};
 
 const std::unordered_map<Request::Type, std::string_view>
     READ_REQUEST_TYPE_TO_STR = {
-        {Request::Type::GET_BUS, "Bus"}, {Request::Type::GET_STOP, "Stop"}, {Request::Type::GET_ROUTE, "Route"}};
+        {Request::Type::GET_BUS, "Bus"}, {Request::Type::GET_STOP, "Stop"}, {Request::Type::GET_ROUTE, "Route"},
+        {Request::Type::GET_ROUTE_VIA, "RouteVia"}, {Request::Type::GET_NEAREST_STOPS, "NearestStops"},
+        {Request::Type::SEARCH_STOPS, "StopSearch"}};
 
 
 
 template <typename ResultType>
 struct ReadRequest : Request{
   using Request::Request;
-  virtual ResultType Process(const bus::BusManager& manager) const = 0;
+  virtual ResultType Process(const bus::FrozenNetwork& network) const = 0;
   size_t request_id_{0};
 };
 
@@ -59,7 +70,7 @@ struct ModifyRequest : Request {
 
 struct AddStopRequest : ModifyRequest {
   AddStopRequest() : ModifyRequest(Request::Type::ADD_STOP){};
-  void ParseFromJson(const Json::Node& node) override;
+  void ParseFromJson(const Json::Value& node) override;
   void ParseFrom(std::string_view input) override;
   void Process(bus::BusManager& manager) const override;
 
@@ -73,7 +84,7 @@ struct AddStopRequest : ModifyRequest {
 
 struct AddBusRequest : ModifyRequest {
   AddBusRequest() : ModifyRequest(Request::Type::ADD_BUS){};
-  void ParseFromJson(const Json::Node& node) override;
+  void ParseFromJson(const Json::Value& node) override;
   void ParseFrom(std::string_view input) override;
   void Process(bus::BusManager& manager) const override;
   
@@ -82,6 +93,19 @@ struct AddBusRequest : ModifyRequest {
   bus::BusRecord::RouteType type_{};
 };
 
+// -----------------------------------------------------------
+// Add trip request
+
+struct AddTripRequest : ModifyRequest {
+  AddTripRequest() : ModifyRequest(Request::Type::ADD_TRIP){};
+  void ParseFromJson(const Json::Value& node) override;
+  void ParseFrom(std::string_view input) override;
+  void Process(bus::BusManager& manager) const override;
+
+  std::string bus_;
+  std::vector<double> times_;
+};
+
 // --------------------------------------------------------
 // Get bus info request
 
@@ -98,9 +122,9 @@ std::ostream& operator<<(std::ostream& out, const BusInfo& info);
 
 struct GetBusInfoRequest : ReadRequest<BusInfo>{
   GetBusInfoRequest() : ReadRequest(Request::Type::GET_BUS){};
-  void ParseFromJson(const Json::Node& node) override;
+  void ParseFromJson(const Json::Value& node) override;
   void ParseFrom(std::string_view input) override;
-  BusInfo Process(const bus::BusManager& manager) const override;
+  BusInfo Process(const bus::FrozenNetwork& network) const override;
 
   std::string name_;
 };
@@ -108,12 +132,14 @@ struct GetBusInfoRequest : ReadRequest<BusInfo>{
 // --------------------------------------------------------------
 // Get stop info request
 
+// Bus names are resolved through the pool only when the answer is written
 struct StopInfo {
-  StopInfo(const std::set<std::string_view>& buses) : buses_(std::addressof(buses)){};
+  StopInfo(std::span<const bus::NameId> buses, const bus::NamePool& names)
+      : buses_(buses), names_(std::addressof(names)){};
   StopInfo() = default;
-  std::optional<const std::set<std::string_view>*> buses_;
+  std::optional<std::span<const bus::NameId>> buses_;
+  const bus::NamePool* names_{nullptr};
   size_t request_id_{0};
-  //const std::set<std::string_view>& buses_;
   uint8_t error_code_{0};
 };
 
@@ -121,9 +147,9 @@ std::ostream& operator<<(std::ostream& out, const StopInfo& info);
 
 struct GetStopInfoRequest : ReadRequest<StopInfo> {
   GetStopInfoRequest() : ReadRequest(Request::Type::GET_STOP){};
-  void ParseFromJson(const Json::Node& node) override;
+  void ParseFromJson(const Json::Value& node) override;
   void ParseFrom(std::string_view input) override;
-  StopInfo Process(const bus::BusManager& manager) const override;
+  StopInfo Process(const bus::FrozenNetwork& network) const override;
 
   std::string name_;
 };
@@ -138,16 +164,18 @@ struct RouteItem {
   double time_{0.0};
 };
 
+// Names are views to the name pool of the manager which answered the
+// request, they are turned into text only when the answer is written
 struct BusRouteItem : RouteItem {
-  BusRouteItem(std::string bus, double time, uint32_t span)
-      : bus_(std::move(bus)), RouteItem(time), span_count_(span){};
-  std::string bus_;
+  BusRouteItem(std::string_view bus, double time, uint32_t span)
+      : bus_(bus), RouteItem(time), span_count_(span){};
+  std::string_view bus_;
   uint32_t span_count_{0};
 };
 
 struct WaitRouteItem : RouteItem {
-  WaitRouteItem(std::string stop, double time) : stop_name_(std::move(stop)), RouteItem(time) {};
-  std::string stop_name_;
+  WaitRouteItem(std::string_view stop, double time) : stop_name_(stop), RouteItem(time) {};
+  std::string_view stop_name_;
 };
 
 struct RouteInfo {
@@ -162,32 +190,102 @@ struct RouteInfo {
 struct GetRouteInfoRequest : ReadRequest<RouteInfo> {
   GetRouteInfoRequest() : ReadRequest(Request::Type::GET_ROUTE){};
 
-  void ParseFromJson(const Json::Node& node) override;
+  void ParseFromJson(const Json::Value& node) override;
   void ParseFrom(std::string_view input) override;
-  RouteInfo Process(const bus::BusManager& manager) const override;
+  RouteInfo Process(const bus::FrozenNetwork& network) const override;
 
   std::string from_;
   std::string to_;
+  bool min_transfers_{false};
+  double departure_time_{0};
+};
+
+// ---------------------------------------------------------------
+// Get route through several stops request
+
+struct GetRouteViaInfoRequest : ReadRequest<RouteInfo> {
+  GetRouteViaInfoRequest() : ReadRequest(Request::Type::GET_ROUTE_VIA){};
+
+  void ParseFromJson(const Json::Value& node) override;
+  void ParseFrom(std::string_view input) override;
+  RouteInfo Process(const bus::FrozenNetwork& network) const override;
+
+  std::vector<std::string> stops_;
+  bool min_transfers_{false};
+  double departure_time_{0};
+};
+
+// ---------------------------------------------------------------
+// Get nearest stops request
+
+// Stop names are views to the name pool of the network
+struct NearestStopsInfo {
+  std::vector<std::pair<std::string_view, double>> stops_;
+  size_t request_id_{0};
+  uint8_t error_code_{0};
 };
 
+struct GetNearestStopsRequest : ReadRequest<NearestStopsInfo> {
+  GetNearestStopsRequest() : ReadRequest(Request::Type::GET_NEAREST_STOPS){};
+
+  void ParseFromJson(const Json::Value& node) override;
+  void ParseFrom(std::string_view input) override;
+  NearestStopsInfo Process(const bus::FrozenNetwork& network) const override;
+
+  bus::Coordinates place_;
+  size_t count_{0};
+  double radius_{std::numeric_limits<double>::infinity()};
+};
+
+// ---------------------------------------------------------------
+// Stop search request
+
+// Stop names are views to the name pool of the network
+struct StopSearchInfo {
+  std::vector<std::string_view> stops_;
+  size_t request_id_{0};
+  uint8_t error_code_{0};
+};
+
+struct StopSearchRequest : ReadRequest<StopSearchInfo> {
+  StopSearchRequest() : ReadRequest(Request::Type::SEARCH_STOPS){};
+
+  void ParseFromJson(const Json::Value& node) override;
+  void ParseFrom(std::string_view input) override;
+  StopSearchInfo Process(const bus::FrozenNetwork& network) const override;
+
+  std::string query_;
+  size_t count_{0};
+  uint32_t max_edits_{0};
+};
+
+// Finds single leg with the algorithm network is frozen with
+std::optional<std::pair<std::vector<RouteInfo::RouteItemVar>, double>>
+FindRouteItems(const bus::FrozenNetwork& network, std::string_view from,
+               std::string_view to, bool min_transfers, double departure_time);
+std::optional<std::pair<std::vector<RouteInfo::RouteItemVar>, double>>
+FindRouteItems(const bus::FrozenNetwork& network, bus::StopId from,
+               bus::StopId to, bool min_transfers, double departure_time);
+
+// Converts journey found by RAPTOR or CSA to the same items graph routes produce
+std::pair<std::vector<RouteInfo::RouteItemVar>, double> InterpretJourney(
+    const bus::FrozenNetwork& network, const bus::Journey& journey);
+
 class RouteInterpreter {
  public:
-  using Router = bus::BusManagerWithRouter::Router;
-  using Graph = bus::BusManagerWithRouter::GraphType;
+  using Graph = bus::FrozenNetwork::GraphType;
 
-  RouteInterpreter(const bus::BusManagerWithRouter& manager)
-      : manager_(manager),
-        router_(manager.GetRouter()),
-        graph_(manager.GetRouteGraph()){};
+  RouteInterpreter(const bus::FrozenNetwork& network)
+      : network_(network),
+        graph_(network.GetRouteGraph()){};
 
   std::pair<std::vector<RouteInfo::RouteItemVar>, double> InterpretRoute(
-      const Router::RouteInfo& info) const;
+      const bus::GraphRoute& route) const;
 
  private:
-  std::optional<RouteInfo::RouteItemVar> GetItem(Router::RouteId id, size_t current_edge) const;
+  std::optional<RouteInfo::RouteItemVar> GetItem(::Graph::EdgeId edge_id) const;
 
 
-  const bus::BusManagerWithRouter& manager_;
-  const Router& router_;
+  const bus::FrozenNetwork& network_;
   const Graph& graph_;
 };
\ No newline at end of file
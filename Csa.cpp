@@ -0,0 +1,135 @@
+#include "Csa.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+
+namespace bus {
+
+ConnectionScanRouter::ConnectionScanRouter(const BusManager& manager)
+    : stop_count_(manager.GetStopCount()) {
+  for (const auto& trip : manager.GetTrips()) {
+    auto bus = manager.GetBus(trip.bus);
+    if (!bus) {
+      throw std::runtime_error("Trip refers to unknown bus " +
+                               std::string(trip.bus));
+    }
+    AddTrip(bus->get(), trip.times);
+  }
+
+  std::sort(connections_.begin(), connections_.end(),
+            [](const Connection& lhs, const Connection& rhs) {
+              return std::tie(lhs.departure, lhs.arrival, lhs.trip, lhs.idx) <
+                     std::tie(rhs.departure, rhs.arrival, rhs.trip, rhs.idx);
+            });
+}
+
+ConnectionScanRouter::ConnectionScanRouter(
+    size_t stop_count, std::vector<Connection> connections,
+    std::vector<std::string_view> trip_buses)
+    : stop_count_(stop_count),
+      connections_(std::move(connections)),
+      trip_buses_(std::move(trip_buses)) {
+}
+
+void ConnectionScanRouter::AddTrip(const BusRecord& bus,
+                                   const std::vector<double>& times) {
+  // Stops in order of passing, linear buses go there and back
+  const auto& stops = bus.GetStops();
+  std::vector<StopId> sequence;
+  sequence.reserve(bus.GetStopsOnRoute());
+  sequence.assign(stops.begin(), stops.end());
+  if (bus.GetType() == BusRecord::RouteType::Linear && !stops.empty()) {
+    sequence.insert(sequence.end(), std::next(stops.rbegin()), stops.rend());
+  }
+
+  if (times.size() != sequence.size()) {
+    throw std::runtime_error("Trip of bus " + std::string(bus.GetName()) +
+                             " has wrong amount of times");
+  }
+  if (!std::is_sorted(times.begin(), times.end())) {
+    throw std::runtime_error("Trip of bus " + std::string(bus.GetName()) +
+                             " goes back in time");
+  }
+
+  const auto trip = static_cast<uint32_t>(trip_buses_.size());
+  trip_buses_.push_back(bus.GetName());
+  for (size_t i = 0; i + 1 < sequence.size(); ++i) {
+    connections_.push_back({times[i], times[i + 1], sequence[i],
+                            sequence[i + 1], trip, static_cast<uint32_t>(i)});
+  }
+}
+
+std::optional<Journey> ConnectionScanRouter::FindRoute(
+    size_t from, size_t to, double departure_time) const {
+  if (from >= stop_count_ || to >= stop_count_) {
+    return std::nullopt;
+  }
+  static constexpr double kInfinity = std::numeric_limits<double>::infinity();
+
+  // Earliest arrival at every stop and connections of the trip leg used
+  struct Parent {
+    uint32_t board{kNoConnection};
+    uint32_t alight{kNoConnection};
+  };
+  std::vector<double> arrival(stop_count_, kInfinity);
+  std::vector<Parent> parents(stop_count_);
+  std::vector<uint32_t> trip_board(trip_buses_.size(), kNoConnection);
+  arrival[from] = departure_time;
+
+  auto first = std::lower_bound(
+      connections_.begin(), connections_.end(), departure_time,
+      [](const Connection& c, double time) { return c.departure < time; });
+
+  for (auto it = first; it != connections_.end(); ++it) {
+    const Connection& c = *it;
+    if (c.departure >= arrival[to]) {
+      break;
+    }
+    const auto idx = static_cast<uint32_t>(it - connections_.begin());
+    if (trip_board[c.trip] == kNoConnection) {
+      if (arrival[c.from_stop] > c.departure) {
+        continue;
+      }
+      trip_board[c.trip] = idx;
+    }
+    if (c.arrival < arrival[c.to_stop]) {
+      arrival[c.to_stop] = c.arrival;
+      parents[c.to_stop] = {trip_board[c.trip], idx};
+    }
+  }
+
+  if (arrival[to] == kInfinity) {
+    return std::nullopt;
+  }
+
+  Journey journey;
+  journey.total_time = arrival[to] - departure_time;
+  for (size_t stop = to; stop != from;) {
+    const Connection& board = connections_[parents[stop].board];
+    const Connection& alight = connections_[parents[stop].alight];
+    journey.legs.push_back({board.from_stop, trip_buses_[board.trip],
+                            alight.idx - board.idx + 1,
+                            board.departure - arrival[board.from_stop],
+                            alight.arrival - board.departure});
+    stop = board.from_stop;
+  }
+  std::reverse(journey.legs.begin(), journey.legs.end());
+  return journey;
+}
+
+size_t ConnectionScanRouter::GetStopCount() const noexcept {
+  return stop_count_;
+}
+
+const std::vector<Connection>& ConnectionScanRouter::GetConnections()
+    const noexcept {
+  return connections_;
+}
+
+const std::vector<std::string_view>& ConnectionScanRouter::GetTripBuses()
+    const noexcept {
+  return trip_buses_;
+}
+
+}  // namespace bus
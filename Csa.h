@@ -0,0 +1,58 @@
+#pragma once
+#include "BusManager.h"
+#include "Journey.h"
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace bus {
+
+// Elementary hop of a trip between two consecutive stops.
+// Plain fixed-width layout so the array can be dumped or mapped as is
+struct Connection {
+  double departure;
+  double arrival;
+  uint32_t from_stop;
+  uint32_t to_stop;
+  uint32_t trip;
+  uint32_t idx;  // position of the connection inside its trip
+};
+
+static_assert(std::is_trivially_copyable_v<Connection>);
+
+// Earliest arrival routing over timetables (Connection Scan Algorithm).
+// Connections of all trips are sorted by departure, a query is one linear
+// pass starting from the requested departure time
+class ConnectionScanRouter {
+ public:
+  // Throws std::runtime_error if a trip does not match its bus
+  explicit ConnectionScanRouter(const BusManager& manager);
+
+  // Connections sorted as above, names of the buses must outlive the router
+  ConnectionScanRouter(size_t stop_count, std::vector<Connection> connections,
+                       std::vector<std::string_view> trip_buses);
+
+  [[nodiscard]] std::optional<Journey> FindRoute(size_t from, size_t to,
+                                                 double departure_time) const;
+
+  [[nodiscard]] size_t GetStopCount() const noexcept;
+
+  [[nodiscard]] const std::vector<Connection>& GetConnections() const noexcept;
+
+  // Bus of every trip, indexed by Connection::trip
+  [[nodiscard]] const std::vector<std::string_view>& GetTripBuses() const noexcept;
+
+ private:
+  static constexpr uint32_t kNoConnection = UINT32_MAX;
+
+  void AddTrip(const BusRecord& bus, const std::vector<double>& times);
+
+  size_t stop_count_;
+  std::vector<Connection> connections_;
+  std::vector<std::string_view> trip_buses_;
+};
+
+}  // namespace bus
@@ -0,0 +1,228 @@
+#include "FrozenNetwork.h"
+#include <stdexcept>
+
+namespace bus {
+
+namespace {
+
+SpatialIndex MakeStopPositions(NetworkTables& tables) {
+  if (!tables.stop_positions) {
+    return SpatialIndex(tables.stop_places);
+  }
+  SpatialIndex index(std::move(*tables.stop_positions));
+  tables.stop_positions.reset();
+  return index;
+}
+
+StopNameIndex MakeStopNameIndex(NetworkTables& tables) {
+  if (!tables.stop_name_records) {
+    return {tables.names, tables.stop_names};
+  }
+  StopNameIndex index(tables.names, tables.stop_names, *tables.stop_name_records);
+  tables.stop_name_records.reset();
+  return index;
+}
+
+}  // namespace
+
+FrozenNetwork::FrozenNetwork(NetworkTables tables)
+    : tables_(std::move(tables)),
+      stop_positions_(MakeStopPositions(tables_)),
+      stop_names_(MakeStopNameIndex(tables_)) {
+  // Built here as it keeps a reference to the graph of this object
+  if (tables_.graph && tables_.routes) {
+    router_.emplace(*tables_.graph, std::move(*tables_.routes));
+  } else if (tables_.graph) {
+    router_.emplace(*tables_.graph);
+  }
+  tables_.routes.reset();
+}
+
+const NetworkTables& FrozenNetwork::GetTables() const noexcept {
+  return tables_;
+}
+
+const NamePool& FrozenNetwork::GetNames() const noexcept {
+  return tables_.names;
+}
+
+size_t FrozenNetwork::GetStopCount() const noexcept {
+  return tables_.stop_names.size();
+}
+
+std::optional<StopId> FrozenNetwork::FindStop(std::string_view name) const {
+  auto id = tables_.names.Find(name);
+  if (!id || *id >= tables_.stop_by_name.size() ||
+      tables_.stop_by_name[*id] == NetworkTables::kNoRecord) {
+    return std::nullopt;
+  }
+  return tables_.stop_by_name[*id];
+}
+
+std::string_view FrozenNetwork::GetStopName(StopId id) const {
+  return tables_.names.Get(tables_.stop_names.at(id));
+}
+
+const Coordinates& FrozenNetwork::GetStopCoordinates(StopId id) const {
+  return tables_.stop_places.at(id);
+}
+
+const SpatialIndex& FrozenNetwork::GetStopPositions() const noexcept {
+  return stop_positions_;
+}
+
+const StopNameIndex& FrozenNetwork::GetStopNameIndex() const noexcept {
+  return stop_names_;
+}
+
+std::vector<StopMatch> FrozenNetwork::SearchStops(std::string_view query,
+                                                  size_t count,
+                                                  uint32_t max_edits) const {
+  return stop_names_.FindFuzzy(query, count, max_edits);
+}
+
+std::vector<NearbyStop> FrozenNetwork::FindNearestStops(const Coordinates& place,
+                                                        size_t count,
+                                                        double radius) const {
+  return stop_positions_.FindNearest(place, count, radius);
+}
+
+std::span<const NameId> FrozenNetwork::GetStopBuses(StopId id) const {
+  const uint32_t end = tables_.stop_bus_offsets.at(id + 1);
+  const uint32_t begin = tables_.stop_bus_offsets[id];
+  return {tables_.stop_buses.data() + begin, end - begin};
+}
+
+auto FrozenNetwork::FindBus(std::string_view name) const
+    -> std::optional<std::reference_wrapper<const FrozenBus>> {
+  auto id = tables_.names.Find(name);
+  if (!id || *id >= tables_.bus_by_name.size() ||
+      tables_.bus_by_name[*id] == NetworkTables::kNoRecord) {
+    return std::nullopt;
+  }
+  return tables_.buses[tables_.bus_by_name[*id]];
+}
+
+std::span<const FrozenBus> FrozenNetwork::GetBuses() const noexcept {
+  return tables_.buses;
+}
+
+std::span<const StopId> FrozenNetwork::GetBusStops(const FrozenBus& bus) const {
+  return {tables_.bus_stops.data() + bus.first_stop, bus.stop_count};
+}
+
+const RoadDistanceTable& FrozenNetwork::GetDistances() const noexcept {
+  return tables_.distances;
+}
+
+std::span<const TripRecord> FrozenNetwork::GetTrips() const noexcept {
+  return tables_.trips;
+}
+
+RoutingAlgorithm FrozenNetwork::GetRoutingAlgorithm() const noexcept {
+  return tables_.algorithm;
+}
+
+//-------------------------------------------------------------------
+// Routing
+
+const FrozenNetwork::GraphType& FrozenNetwork::GetRouteGraph() const {
+  if (!tables_.graph.has_value()) {
+    throw std::runtime_error("Route graph has not been created");
+  }
+  return tables_.graph.value();
+}
+
+const FrozenNetwork::Router& FrozenNetwork::GetRouter() const {
+  if (!router_.has_value()) {
+    throw std::runtime_error("Router has not been initialized");
+  }
+  return router_.value();
+}
+
+const RaptorRouter& FrozenNetwork::GetRaptorRouter() const {
+  if (!tables_.raptor.has_value()) {
+    throw std::runtime_error("Raptor router has not been initialized");
+  }
+  return tables_.raptor.value();
+}
+
+const ConnectionScanRouter& FrozenNetwork::GetTimetableRouter() const {
+  if (!tables_.timetable.has_value()) {
+    throw std::runtime_error("Timetable router has not been initialized");
+  }
+  return tables_.timetable.value();
+}
+
+std::optional<size_t> FrozenNetwork::GetIndexFromStop(std::string_view name,
+                                                      NodeType type) const {
+  auto stop = FindStop(name);
+  if (!stop) {
+    return std::nullopt;
+  }
+  return ToVertexId(*stop, type);
+}
+
+std::optional<std::pair<std::string_view, NodeType>>
+FrozenNetwork::GetStopFromIndex(size_t num) const {
+  if (num >= 2 * GetStopCount()) {
+    return std::nullopt;
+  }
+  return std::pair{GetStopName(static_cast<StopId>(num / 2)),
+                   static_cast<NodeType>(num % 2)};
+}
+
+std::optional<GraphRoute> FrozenNetwork::GetRoute(std::string_view from,
+                                                  std::string_view to) const {
+  auto start = FindStop(from);
+  auto end = FindStop(to);
+  if (!start || !end) {
+    return std::nullopt;
+  }
+  return GetRoute(*start, *end);
+}
+
+std::optional<GraphRoute> FrozenNetwork::GetRoute(StopId from, StopId to) const {
+  GraphRoute route{0, {}};
+  auto weight = GetRouter().BuildRoute(ToVertexId(from, NodeType::WAIT),
+                                       ToVertexId(to, NodeType::WAIT),
+                                       route.edges);
+  if (!weight) {
+    return std::nullopt;
+  }
+  route.weight = *weight;
+  return route;
+}
+
+std::optional<Journey> FrozenNetwork::GetRaptorRoute(
+    std::string_view from, std::string_view to,
+    RaptorRouter::Criterion criterion) const {
+  auto start = FindStop(from);
+  auto end = FindStop(to);
+  if (!start || !end) {
+    return std::nullopt;
+  }
+  return GetRaptorRoute(*start, *end, criterion);
+}
+
+std::optional<Journey> FrozenNetwork::GetRaptorRoute(
+    StopId from, StopId to, RaptorRouter::Criterion criterion) const {
+  return GetRaptorRouter().FindRoute(from, to, criterion);
+}
+
+std::optional<Journey> FrozenNetwork::GetTimetableRoute(
+    std::string_view from, std::string_view to, double departure_time) const {
+  auto start = FindStop(from);
+  auto end = FindStop(to);
+  if (!start || !end) {
+    return std::nullopt;
+  }
+  return GetTimetableRoute(*start, *end, departure_time);
+}
+
+std::optional<Journey> FrozenNetwork::GetTimetableRoute(
+    StopId from, StopId to, double departure_time) const {
+  return GetTimetableRouter().FindRoute(from, to, departure_time);
+}
+
+}  // namespace bus
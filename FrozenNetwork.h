@@ -0,0 +1,159 @@
+#pragma once
+#include "StopsGraphManager.h"
+#include "SpatialIndex.h"
+#include "StopNameIndex.h"
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace bus {
+
+// Bus of a frozen network, its stops are a slice of one shared array
+struct FrozenBus {
+  NameId name;
+  BusRecord::RouteType type;
+  BusStats stats;
+  uint32_t first_stop;
+  uint32_t stop_count;
+};
+
+// Route found on the precomputed stop graph
+struct GraphRoute {
+  utility::WeightWithSpan weight;
+  std::vector<Graph::EdgeId> edges;
+};
+
+// Flat tables a frozen network is made of, filled by Freeze of a manager
+struct NetworkTables {
+  static constexpr uint32_t kNoRecord = UINT32_MAX;
+
+  NamePool names;
+  // Indexed by NameId, kNoRecord for names of the other kind
+  std::vector<StopId> stop_by_name;
+  std::vector<uint32_t> bus_by_name;
+
+  // Indexed by StopId
+  std::vector<NameId> stop_names;
+  std::vector<Coordinates> stop_places;
+  std::vector<uint32_t> stop_bus_offsets;
+  std::vector<NameId> stop_buses;
+
+  std::vector<FrozenBus> buses;
+  std::vector<StopId> bus_stops;
+  RoadDistanceTable distances;
+  // Kept so that the next network can be built from this one
+  std::vector<TripRecord> trips;
+
+  // Left empty by managers without router
+  RoutingAlgorithm algorithm{RoutingAlgorithm::GRAPH};
+  std::optional<BusManagerWithRouter::GraphType> graph;
+  // Routes of the graph computed before, e.g. read from a snapshot.
+  // The router computes them from the graph when empty
+  std::optional<BusManagerWithRouter::Router::RoutesInternalData> routes;
+  // Stop indexes built before in the same way, they are built from stop
+  // places and names when empty
+  std::optional<SpatialIndex::Tables> stop_positions;
+  std::optional<std::vector<StopNameIndex::Record>> stop_name_records;
+  std::optional<RaptorRouter> raptor;
+  std::optional<ConnectionScanRouter> timetable;
+};
+
+// Read-only network all stat requests are served from. It owns every
+// table it needs, the manager it was frozen from may be destroyed.
+// Nothing is modified by queries, so one network may serve many threads
+class FrozenNetwork {
+ public:
+  using GraphType = BusManagerWithRouter::GraphType;
+  using Router = BusManagerWithRouter::Router;
+
+  explicit FrozenNetwork(NetworkTables tables);
+
+  // Router refers to the graph inside, so the network stays in place
+  FrozenNetwork(const FrozenNetwork&) = delete;
+  FrozenNetwork& operator=(const FrozenNetwork&) = delete;
+
+  [[nodiscard]] const NetworkTables& GetTables() const noexcept;
+
+  [[nodiscard]] const NamePool& GetNames() const noexcept;
+
+  [[nodiscard]] size_t GetStopCount() const noexcept;
+
+  [[nodiscard]] std::optional<StopId> FindStop(std::string_view name) const;
+
+  [[nodiscard]] std::string_view GetStopName(StopId id) const;
+
+  [[nodiscard]] const Coordinates& GetStopCoordinates(StopId id) const;
+
+  [[nodiscard]] const SpatialIndex& GetStopPositions() const noexcept;
+
+  [[nodiscard]] const StopNameIndex& GetStopNameIndex() const noexcept;
+
+  // Up to count stops by prefix of their names, or allowing edits when
+  // max_edits is not zero, see StopNameIndex::FindFuzzy
+  [[nodiscard]] std::vector<StopMatch> SearchStops(std::string_view query,
+                                                   size_t count,
+                                                   uint32_t max_edits = 0) const;
+
+  // Up to count stops within radius metres of the place, nearest first
+  [[nodiscard]] std::vector<NearbyStop> FindNearestStops(const Coordinates& place,
+                                                         size_t count,
+                                                         double radius) const;
+
+  // Buses passing the stop in order of their names
+  [[nodiscard]] std::span<const NameId> GetStopBuses(StopId id) const;
+
+  [[nodiscard]] auto FindBus(std::string_view name) const
+      -> std::optional<std::reference_wrapper<const FrozenBus>>;
+
+  [[nodiscard]] std::span<const FrozenBus> GetBuses() const noexcept;
+
+  [[nodiscard]] std::span<const StopId> GetBusStops(const FrozenBus& bus) const;
+
+  [[nodiscard]] const RoadDistanceTable& GetDistances() const noexcept;
+
+  [[nodiscard]] std::span<const TripRecord> GetTrips() const noexcept;
+
+  [[nodiscard]] RoutingAlgorithm GetRoutingAlgorithm() const noexcept;
+
+  // Throw std::runtime_error if the network was frozen without them
+  [[nodiscard]] const GraphType& GetRouteGraph() const;
+  [[nodiscard]] const Router& GetRouter() const;
+  [[nodiscard]] const RaptorRouter& GetRaptorRouter() const;
+  [[nodiscard]] const ConnectionScanRouter& GetTimetableRouter() const;
+
+  [[nodiscard]] std::optional<size_t> GetIndexFromStop(
+      std::string_view name, NodeType type) const;
+  [[nodiscard]] std::optional<std::pair<std::string_view, NodeType>>
+  GetStopFromIndex(size_t num) const;
+
+  // Routes between stops given by name are empty if either is not found
+  [[nodiscard]] std::optional<GraphRoute> GetRoute(std::string_view from,
+                                                   std::string_view to) const;
+  [[nodiscard]] std::optional<GraphRoute> GetRoute(StopId from, StopId to) const;
+
+  [[nodiscard]] std::optional<Journey> GetRaptorRoute(
+      std::string_view from, std::string_view to,
+      RaptorRouter::Criterion criterion = RaptorRouter::Criterion::FASTEST) const;
+  [[nodiscard]] std::optional<Journey> GetRaptorRoute(
+      StopId from, StopId to,
+      RaptorRouter::Criterion criterion = RaptorRouter::Criterion::FASTEST) const;
+
+  // Earliest arrival by trips leaving not before departure_time
+  [[nodiscard]] std::optional<Journey> GetTimetableRoute(
+      std::string_view from, std::string_view to, double departure_time) const;
+  [[nodiscard]] std::optional<Journey> GetTimetableRoute(
+      StopId from, StopId to, double departure_time) const;
+
+ private:
+  NetworkTables tables_;
+  std::optional<Router> router_;
+  // Built from stop places and names unless the tables bring them
+  SpatialIndex stop_positions_;
+  StopNameIndex stop_names_;
+};
+
+}  // namespace bus
@@ -0,0 +1,219 @@
+#include "Haversine.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define BUS_HAVERSINE_AVX2 1
+#include <immintrin.h>
+#define BUS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+namespace bus {
+
+static constexpr double kEarthRadius = 6371000;
+
+// Arrays of CoordinateTable passed to kernels
+struct CoordinateArrays {
+  const double* cos_lat;
+  const double* sin_half_lat;
+  const double* cos_half_lat;
+  const double* sin_half_lon;
+  const double* cos_half_lon;
+};
+
+//-------------------------------------------------------------------
+// Scalar kernel
+
+static double PairDistance(const CoordinateArrays& c, StopId a, StopId b) {
+  // sin((x_b - x_a) / 2) from half angles avoids cancellation near zero
+  const double sin_dlat = c.sin_half_lat[b] * c.cos_half_lat[a] -
+                          c.cos_half_lat[b] * c.sin_half_lat[a];
+  const double sin_dlon = c.sin_half_lon[b] * c.cos_half_lon[a] -
+                          c.cos_half_lon[b] * c.sin_half_lon[a];
+  const double h = sin_dlat * sin_dlat +
+                   c.cos_lat[a] * c.cos_lat[b] * sin_dlon * sin_dlon;
+  return 2 * std::asin(std::sqrt(std::min(h, 1.0))) * kEarthRadius;
+}
+
+static void DistancesScalar(const CoordinateArrays& c, const StopId* ids,
+                            size_t pairs, double* out) {
+  for (size_t i = 0; i < pairs; ++i) {
+    out[i] = PairDistance(c, ids[i], ids[i + 1]);
+  }
+}
+
+//-------------------------------------------------------------------
+// AVX2 kernel, 4 pairs at a time with asin evaluated in vector registers
+
+#ifdef BUS_HAVERSINE_AVX2
+
+namespace {
+
+// Rational approximations of asin from Cephes, accurate to 1 ulp
+constexpr double kAsinP[] = {4.253011369004428248960E-3, -6.019598008014123785661E-1,
+                             5.444622390564711410273E0,  -1.626247967210700244449E1,
+                             1.956261983317594739197E1,  -8.198089802484824371615E0};
+constexpr double kAsinQ[] = {1.0,
+                             -1.474091372988853791896E1, 7.049610280856842141659E1,
+                             -1.471791292232726029859E2, 1.395105614657485689735E2,
+                             -4.918853881490881290097E1};
+constexpr double kAsinR[] = {2.967721961301243206100E-3, -5.634242780008963776856E-1,
+                             6.968710824104713396794E0,  -2.556901049652824852289E1,
+                             2.853665548261061424989E1};
+constexpr double kAsinS[] = {1.0,
+                             -2.194779531642920639778E1, 1.470656354026814941758E2,
+                             -3.838770957603691357202E2, 3.424398657913078477438E2};
+constexpr double kPiOver4 = 7.85398163397448309616E-1;
+constexpr double kMoreBits = 6.123233995736765886130E-17;
+
+template <size_t N>
+BUS_TARGET_AVX2 __m256d Horner(__m256d x, const double (&coefficients)[N]) {
+  __m256d result = _mm256_set1_pd(coefficients[0]);
+  for (size_t i = 1; i < N; ++i) {
+    result = _mm256_fmadd_pd(result, x, _mm256_set1_pd(coefficients[i]));
+  }
+  return result;
+}
+
+// asin of values in [0, 1]. Branches are blended, the one no value
+// needs is skipped: stops of one city never take the second
+BUS_TARGET_AVX2 __m256d Asin(__m256d a) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d pi_over_4 = _mm256_set1_pd(kPiOver4);
+  const __m256d near_one = _mm256_cmp_pd(a, _mm256_set1_pd(0.625), _CMP_GT_OQ);
+
+  const __m256d a2 = _mm256_mul_pd(a, a);
+  const __m256d small = _mm256_fmadd_pd(
+      a, _mm256_div_pd(_mm256_mul_pd(a2, Horner(a2, kAsinP)), Horner(a2, kAsinQ)),
+      a);
+  if (_mm256_testz_pd(near_one, near_one)) {
+    return small;
+  }
+
+  // asin(a) = pi / 2 - 2 asin(sqrt((1 - a) / 2)) near 1
+  const __m256d w = _mm256_sub_pd(one, a);
+  const __m256d p =
+      _mm256_div_pd(_mm256_mul_pd(w, Horner(w, kAsinR)), Horner(w, kAsinS));
+  const __m256d s = _mm256_sqrt_pd(_mm256_add_pd(w, w));
+  const __m256d large = _mm256_add_pd(
+      _mm256_sub_pd(_mm256_sub_pd(pi_over_4, s),
+                    _mm256_sub_pd(_mm256_mul_pd(s, p), _mm256_set1_pd(kMoreBits))),
+      pi_over_4);
+
+  return _mm256_blendv_pd(small, large, near_one);
+}
+
+// Hardware gathers are microcoded slowly on many CPUs, four loads are not
+BUS_TARGET_AVX2 __m256d Load(const double* column, const StopId* ids) {
+  return _mm256_set_pd(column[ids[3]], column[ids[2]], column[ids[1]], column[ids[0]]);
+}
+
+BUS_TARGET_AVX2 __m256d SinHalfGap(const double* sin_half, const double* cos_half,
+                                    const StopId* a, const StopId* b) {
+  return _mm256_sub_pd(_mm256_mul_pd(Load(sin_half, b), Load(cos_half, a)),
+                       _mm256_mul_pd(Load(cos_half, b), Load(sin_half, a)));
+}
+
+}  // namespace
+
+BUS_TARGET_AVX2
+static void DistancesAvx2(const CoordinateArrays& c, const StopId* ids,
+                          size_t pairs, double* out) {
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d diameter = _mm256_set1_pd(2 * kEarthRadius);
+
+  size_t i = 0;
+  for (; i + 4 <= pairs; i += 4) {
+    const StopId* a = ids + i;
+    const StopId* b = ids + i + 1;
+    const __m256d sin_dlat = SinHalfGap(c.sin_half_lat, c.cos_half_lat, a, b);
+    const __m256d sin_dlon = SinHalfGap(c.sin_half_lon, c.cos_half_lon, a, b);
+    const __m256d cos_product = _mm256_mul_pd(Load(c.cos_lat, a), Load(c.cos_lat, b));
+    const __m256d h = _mm256_add_pd(
+        _mm256_mul_pd(sin_dlat, sin_dlat),
+        _mm256_mul_pd(_mm256_mul_pd(cos_product, sin_dlon), sin_dlon));
+    const __m256d angle = Asin(_mm256_sqrt_pd(_mm256_min_pd(h, one)));
+    _mm256_storeu_pd(out + i, _mm256_mul_pd(angle, diameter));
+  }
+  DistancesScalar(c, ids + i, pairs - i, out + i);
+}
+
+#endif
+
+HaversineKernel DetectHaversineKernel() noexcept {
+#ifdef BUS_HAVERSINE_AVX2
+  static const HaversineKernel kernel =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+                                            ? HaversineKernel::AVX2
+                                            : HaversineKernel::SCALAR;
+  return kernel;
+#else
+  return HaversineKernel::SCALAR;
+#endif
+}
+
+//-------------------------------------------------------------------
+// CoordinateTable
+
+void CoordinateTable::Build(const StopArena& stops) {
+  const size_t count = stops.size();
+  for (auto* column : {&cos_lat_, &sin_half_lat_, &cos_half_lat_, &sin_half_lon_,
+                       &cos_half_lon_}) {
+    column->resize(count);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    const auto& place = stops[i].GetCoordinates();
+    const double lat = GradToRad(place.latitude);
+    const double lon = GradToRad(place.longitude);
+    cos_lat_[i] = std::cos(lat);
+    sin_half_lat_[i] = std::sin(lat / 2);
+    cos_half_lat_[i] = std::cos(lat / 2);
+    sin_half_lon_[i] = std::sin(lon / 2);
+    cos_half_lon_[i] = std::cos(lon / 2);
+  }
+}
+
+size_t CoordinateTable::Size() const noexcept {
+  return cos_lat_.size();
+}
+
+void CoordinateTable::ConsecutiveDistances(const StopId* ids, size_t count,
+                                           double* out,
+                                           HaversineKernel kernel) const {
+  if (count < 2) {
+    return;
+  }
+  const CoordinateArrays arrays{cos_lat_.data(), sin_half_lat_.data(),
+                                cos_half_lat_.data(), sin_half_lon_.data(),
+                                cos_half_lon_.data()};
+#ifdef BUS_HAVERSINE_AVX2
+  if (kernel == HaversineKernel::AVX2 &&
+      DetectHaversineKernel() == HaversineKernel::AVX2) {
+    DistancesAvx2(arrays, ids, count - 1, out);
+    return;
+  }
+#endif
+  DistancesScalar(arrays, ids, count - 1, out);
+}
+
+double CoordinateTable::LineLength(const std::vector<StopId>& ids) const {
+  if (ids.size() < 2) {
+    return 0;
+  }
+  std::vector<double> distances(ids.size() - 1);
+  ConsecutiveDistances(ids.data(), ids.size(), distances.data());
+  double length = 0;
+  for (double distance : distances) {
+    length += distance;
+  }
+  return length;
+}
+
+double CoordinateTable::Distance(StopId from, StopId to) const {
+  const StopId ids[] = {from, to};
+  double distance = 0;
+  ConsecutiveDistances(ids, 2, &distance);
+  return distance;
+}
+
+}  // namespace bus
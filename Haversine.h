@@ -0,0 +1,43 @@
+#pragma once
+#include "BusManager.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace bus {
+
+// Kernels computing a batch of distances, results agree within 1e-12
+enum class HaversineKernel { SCALAR, AVX2 };
+
+// AVX2 with FMA when the CPU supports them, scalar otherwise. Checked once
+[[nodiscard]] HaversineKernel DetectHaversineKernel() noexcept;
+
+// Stop coordinates in structure of arrays layout, indexed by StopId,
+// with the half-angle trigonometry of every stop computed once.
+// The scalar kernel gives bit for bit what HaversineDistance gives pair
+// by pair, AVX2 differs in the last bits of asin
+class CoordinateTable {
+ public:
+  void Build(const StopArena& stops);
+
+  [[nodiscard]] size_t Size() const noexcept;
+
+  // Writes count - 1 distances between consecutive stops of ids to out.
+  // AVX2 kernel falls back to the scalar one on CPUs without it
+  void ConsecutiveDistances(const StopId* ids, size_t count, double* out,
+                            HaversineKernel kernel = DetectHaversineKernel()) const;
+
+  // Sum of consecutive distances along the line
+  [[nodiscard]] double LineLength(const std::vector<StopId>& ids) const;
+
+  [[nodiscard]] double Distance(StopId from, StopId to) const;
+
+ private:
+  std::vector<double> cos_lat_;
+  std::vector<double> sin_half_lat_;
+  std::vector<double> cos_half_lat_;
+  std::vector<double> sin_half_lon_;
+  std::vector<double> cos_half_lon_;
+};
+
+}  // namespace bus
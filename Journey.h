@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace bus {
+
+// Route found by searches working on stop ids rather than the stop graph
+struct JourneyLeg {
+  size_t board_stop;  // stop id where we wait for the bus
+  std::string_view bus;
+  uint32_t span;
+  double wait_time;
+  double ride_time;
+};
+
+struct Journey {
+  std::vector<JourneyLeg> legs;
+  double total_time{0};
+};
+
+}  // namespace bus
@@ -0,0 +1,162 @@
+#include "decimal.h"
+
+#include <array>
+#include <bit>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+namespace Json {
+
+namespace {
+
+// Powers of ten a 19 digit mantissa needs to reach every normal double
+constexpr int kMinPower = -342;
+constexpr int kMaxPower = 308;
+
+// 128 bits, also the first 128 bits of a power of ten with the highest
+// one set, truncated
+struct Wide {
+  uint64_t high;
+  uint64_t low;
+};
+
+Wide Multiply(uint64_t lhs, uint64_t rhs) noexcept {
+#if defined(__SIZEOF_INT128__)
+  const unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+  return {static_cast<uint64_t>(product >> 64), static_cast<uint64_t>(product)};
+#elif defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64)
+  uint64_t high;
+  const uint64_t low = _umul128(lhs, rhs, &high);
+  return {high, low};
+#else
+  const uint64_t lhs_low = lhs & 0xFFFFFFFF, lhs_high = lhs >> 32;
+  const uint64_t rhs_low = rhs & 0xFFFFFFFF, rhs_high = rhs >> 32;
+  const uint64_t low = lhs_low * rhs_low;
+  const uint64_t middle1 = lhs_high * rhs_low + (low >> 32);
+  const uint64_t middle2 = lhs_low * rhs_high + (middle1 & 0xFFFFFFFF);
+  return {lhs_high * rhs_high + (middle1 >> 32) + (middle2 >> 32),
+          (middle2 << 32) | (low & 0xFFFFFFFF)};
+#endif
+}
+
+// Big numbers are kept in 32 bit limbs, the least significant first
+using Limbs = vector<uint32_t>;
+
+Wide TopBits(const Limbs& limbs) {
+  const int64_t width = 32 * static_cast<int64_t>(limbs.size() - 1) +
+                        bit_width(limbs.back());
+  auto bit = [&limbs](int64_t index) -> uint64_t {
+    return index < 0 ? 0 : (limbs[index / 32] >> (index % 32)) & 1;
+  };
+  Wide result{0, 0};
+  for (int64_t i = 1; i <= 64; ++i) {
+    result.high = (result.high << 1) | bit(width - i);
+  }
+  for (int64_t i = 65; i <= 128; ++i) {
+    result.low = (result.low << 1) | bit(width - i);
+  }
+  return result;
+}
+
+// Built from exact big numbers: 10^n for positive powers, and
+// floor(2^1312 / 10^n) for negative ones. Dividing by ten step by step
+// keeps the floor exact, and 1312 bits leave more than 128 for 10^342
+array<Wide, kMaxPower - kMinPower + 1> BuildPowers() {
+  array<Wide, kMaxPower - kMinPower + 1> result;
+  Limbs number = {1};
+  for (int power = 0; power <= kMaxPower; ++power) {
+    result[power - kMinPower] = TopBits(number);
+    uint64_t carry = 0;
+    for (uint32_t& limb : number) {
+      carry += static_cast<uint64_t>(limb) * 10;
+      limb = static_cast<uint32_t>(carry);
+      carry >>= 32;
+    }
+    if (carry) {
+      number.push_back(static_cast<uint32_t>(carry));
+    }
+  }
+
+  number.assign(1312 / 32 + 1, 0);
+  number.back() = 1;
+  for (int power = -1; power >= kMinPower; --power) {
+    uint64_t remainder = 0;
+    for (size_t i = number.size(); i-- > 0;) {
+      remainder = (remainder << 32) | number[i];
+      number[i] = static_cast<uint32_t>(remainder / 10);
+      remainder %= 10;
+    }
+    while (number.back() == 0) {
+      number.pop_back();
+    }
+    result[power - kMinPower] = TopBits(number);
+  }
+  return result;
+}
+
+// Filled before main, a lookup needs no guard
+const array<Wide, kMaxPower - kMinPower + 1> kPowers = BuildPowers();
+
+}  // namespace
+
+optional<double> DecimalToDouble(uint64_t mantissa, int exponent, bool negative) {
+  if (mantissa == 0) {
+    return negative ? -0.0 : 0.0;
+  }
+  if (exponent < kMinPower || exponent > kMaxPower) {
+    return nullopt;
+  }
+  const Wide& power = kPowers[exponent - kMinPower];
+
+  const int zeros = countl_zero(mantissa);
+  mantissa <<= zeros;
+  // 217706 / 2^16 is log2(10) to enough digits
+  uint64_t binary_exponent =
+      static_cast<uint64_t>(((217706 * exponent) >> 16) + 64 + 1023) - zeros;
+
+  // The lower half of the power matters only if the product is just
+  // below a change of the ninth bit
+  Wide product = Multiply(mantissa, power.high);
+  if ((product.high & 0x1FF) == 0x1FF && product.low + mantissa < mantissa) {
+    const Wide lower = Multiply(mantissa, power.low);
+    Wide merged{product.high, product.low + lower.high};
+    if (merged.low < product.low) {
+      ++merged.high;
+    }
+    if ((merged.high & 0x1FF) == 0x1FF && merged.low + 1 == 0 &&
+        lower.low + mantissa < mantissa) {
+      return nullopt;
+    }
+    product = merged;
+  }
+
+  // 54 bits with one to round by, exactly halfway cannot be told apart
+  const uint64_t top = product.high >> 63;
+  uint64_t result = product.high >> (top + 9);
+  binary_exponent -= 1 ^ top;
+  if (product.low == 0 && (product.high & 0x1FF) == 0 && (result & 3) == 1) {
+    return nullopt;
+  }
+  result += result & 1;
+  result >>= 1;
+  if (result >> 53) {
+    result >>= 1;
+    ++binary_exponent;
+  }
+  // Subnormal, infinite or not a number
+  if (binary_exponent - 1 >= 0x7FF - 1) {
+    return nullopt;
+  }
+  uint64_t bits = (binary_exponent << 52) | (result & 0x000FFFFFFFFFFFFF);
+  if (negative) {
+    bits |= 0x8000000000000000;
+  }
+  return bit_cast<double>(bits);
+}
+
+}  // namespace Json
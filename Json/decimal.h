@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+
+namespace Json {
+
+// Nearest double to mantissa * 10^exponent by the Eisel-Lemire algorithm:
+// the mantissa is multiplied by a 128 bit approximation of the power of
+// ten, and the product decides the rounding unless it lies too close to
+// a halfway point. Gives nullopt for those rare cases and for results
+// that are subnormal, infinite or too far out, the caller then needs a
+// slower exact conversion
+std::optional<double> DecimalToDouble(uint64_t mantissa, int exponent,
+                                      bool negative);
+
+}  // namespace Json
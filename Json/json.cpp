@@ -1,4 +1,14 @@
 #include "json.h"
+#include "decimal.h"
+#include "../utility/mapped_file.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 using namespace std;
 
@@ -11,6 +21,33 @@ const Node& Document::GetRoot() const {
   return root;
 }
 
+namespace {
+
+// text is a number of the JSON grammar, integer tells that it has only
+// digits. from_chars rounds correctly, so every double printed in full
+// reads back as itself
+variant<size_t, double> ParseNumber(string_view text, bool integer) {
+  const char* const last = text.data() + text.size();
+  if (integer) {
+    size_t result;
+    if (from_chars(text.data(), last, result).ec == errc()) {
+      return result;
+    }
+  }
+  double result;
+  const auto [end, error] = from_chars(text.data(), last, result);
+  // Such numbers are infinite or zero, strtod gives both with the sign
+  if (error == errc::result_out_of_range) {
+    return strtod(string(text).c_str(), nullptr);
+  }
+  if (error != errc() || end != last) {
+    throw runtime_error("Json: bad number " + string(text));
+  }
+  return result;
+}
+
+}  // namespace
+
 Node LoadNode(istream& input);
 
 Node LoadArray(istream& input) {
@@ -36,28 +73,19 @@ Node LoadArray(istream& input) {
 //}
 
 Node LoadDouble(istream& input) {
-  bool negative = false;
-  size_t base = 0;
-  size_t part = 0;
-  uint32_t digits = 0;
-  if (input.peek() == '-') {
-    negative = true;
-    input.get();
-  }
-  while (isdigit(input.peek())) {
-    base *= 10;
-    base += static_cast<size_t>(input.get()) - '0';
+  string text;
+  bool integer = true;
+  for (int c = input.peek(); isdigit(c) || c == '-' || c == '+' || c == '.' ||
+                             c == 'e' || c == 'E';
+       c = input.peek()) {
+    integer = integer && isdigit(c);
+    text += static_cast<char>(input.get());
   }
-  if (input.peek() == '.') {
-    input.get();
-    while (isdigit(input.peek())) {
-      part *= 10;
-      part += static_cast<size_t>(input.get()) - '0';
-      ++digits;
-    }
+  // As always, a stream with nothing left reads as zero
+  if (text.empty()) {
+    return Node(0.0);
   }
-  double result = digits ? base + static_cast<double>(part) / pow(10, digits) : base; 
-  return negative ? -result : result;
+  return visit([](auto number) { return Node(number); }, ParseNumber(text, integer));
 }
 
 Node LoadString(istream& input) {
@@ -117,26 +145,811 @@ Document Load(istream& input) {
   return Document{LoadNode(input)};
 }
 
+//-------------------------------------------------------------------
+// Load from buffer
+
+namespace {
+
+// Exact doubles
+constexpr double kPowers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                              1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                              1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+void AppendUtf8(string& out, uint32_t code) {
+  if (code < 0x80) {
+    out += static_cast<char>(code);
+  } else if (code < 0x800) {
+    out += static_cast<char>(0xC0 | (code >> 6));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    out += static_cast<char>(0xE0 | (code >> 12));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (code >> 18));
+    out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code & 0x3F));
+  }
+}
+
+}  // namespace
+
+Reader::Reader(string_view text)
+    : begin_(text.data()), pos_(text.data()), end_(text.data() + text.size()) {
+}
+
+Reader::Reader(string_view text, vector<uint32_t> structurals)
+    : begin_(text.data()),
+      pos_(text.data()),
+      end_(text.data() + text.size()),
+      structurals_(move(structurals)),
+      next_structural_(structurals_.data()),
+      indexed_(true) {
+}
+
+void Reader::Fail(const char* what) const {
+  throw runtime_error("Json: " + string(what) + " at offset " +
+                      to_string(pos_ - begin_));
+}
+
+void Reader::SkipSpaces() noexcept {
+  // Only whitespace lies before the next offset: strings are read to the
+  // closing quote, and scalars are checked to end at a delimiter
+  if (indexed_) {
+    const uint32_t* const last = structurals_.data() + structurals_.size();
+    while (next_structural_ != last && begin_ + *next_structural_ < pos_) {
+      ++next_structural_;
+    }
+    pos_ = next_structural_ != last ? begin_ + *next_structural_ : end_;
+    return;
+  }
+  while (pos_ != end_ &&
+         (*pos_ == ' ' || *pos_ == '\n' || *pos_ == '\r' || *pos_ == '\t')) {
+    ++pos_;
+  }
+}
+
+char Reader::Peek() {
+  SkipSpaces();
+  if (pos_ == end_) {
+    Fail("unexpected end of input");
+  }
+  return *pos_;
+}
+
+void Reader::Expect(char c) {
+  if (Peek() != c) {
+    Fail("unexpected character");
+  }
+  ++pos_;
+}
+
+bool Reader::IsDigit() const noexcept {
+  return pos_ != end_ && *pos_ >= '0' && *pos_ <= '9';
+}
+
+void Reader::CheckScalarEnd() {
+  if (pos_ == end_) {
+    return;
+  }
+  switch (*pos_) {
+    case ' ': case '\n': case '\r': case '\t':
+    case ',': case ']': case '}':
+      return;
+    default:
+      Fail("unexpected character after a value");
+  }
+}
+
+void Reader::Finish() {
+  SkipSpaces();
+  if (pos_ != end_) {
+    Fail("unexpected data after the root value");
+  }
+}
+
+vector<string_view> Reader::SplitArray() {
+  vector<string_view> elements;
+  if (StartSplit()) {
+    SplitElements(elements, numeric_limits<size_t>::max());
+  }
+  return elements;
+}
+
+bool Reader::StartSplit() {
+  if (!indexed_) {
+    throw logic_error("Json: arrays are split only by readers with an index");
+  }
+  Expect('[');
+  if (Peek() == ']') {
+    ++pos_;
+    return false;
+  }
+  return true;
+}
+
+bool Reader::SplitElements(vector<string_view>& elements, size_t max_count) {
+  const uint32_t* const last = structurals_.data() + structurals_.size();
+  // Every element starts at a structural, pos_ may still be before it
+  const char* start = next_structural_ != last ? begin_ + *next_structural_ : end_;
+  size_t depth = 0;
+  for (const uint32_t* it = next_structural_; it != last; ++it) {
+    const char* const c = begin_ + *it;
+    if (*c == '[' || *c == '{') {
+      ++depth;
+    } else if ((*c == ']' || *c == '}') && depth > 0) {
+      --depth;
+    } else if (depth == 0 && (*c == ',' || *c == ']' || *c == '}')) {
+      pos_ = c;
+      if (*c == '}') {
+        Fail("expected , or ] in array");
+      }
+      elements.emplace_back(start, c - start);
+      ++pos_;
+      next_structural_ = it + 1;
+      if (*c == ']') {
+        return false;
+      }
+      if (--max_count == 0) {
+        return true;
+      }
+      start = next_structural_ != last ? begin_ + *next_structural_ : end_;
+    }
+  }
+  pos_ = end_;
+  Fail("unexpected end of input");
+}
+
+Node Reader::ReadNode() {
+  switch (Peek()) {
+    case '[': {
+      vector<Node> result;
+      ReadArray([this, &result] { result.push_back(ReadNode()); });
+      return Node(move(result));
+    }
+    case '{': {
+      map<string, Node> result;
+      // Like LoadDict, the first of repeated keys is kept
+      ReadObject([this, &result](string_view key) {
+        result.emplace(string(key), ReadNode());
+      });
+      return Node(move(result));
+    }
+    case '"':
+      return Node(ReadString());
+    case 't':
+    case 'f':
+      return Node(ReadBool());
+    default:
+      return visit([](auto number) { return Node(number); }, ReadAnyNumber());
+  }
+}
+
+Value Reader::ReadValue(Arena& arena) {
+  switch (Peek()) {
+    case '[': {
+      const size_t first = elements_.size();
+      ReadArray([this, &arena] {
+        const Value element = ReadValue(arena);
+        elements_.push_back(element);
+      });
+      const size_t size = elements_.size() - first;
+      const Value result(span<const Value>(arena.Copy(elements_.data() + first, size), size));
+      elements_.resize(first);
+      return result;
+    }
+    case '{': {
+      const size_t first = members_.size();
+      ReadObject([this, &arena](string_view key) {
+        key = Keep(key, arena);
+        const Value value = ReadValue(arena);
+        members_.emplace_back(key, value);
+      });
+      const auto begin = members_.begin() + first;
+      stable_sort(begin, members_.end(), [](const Member& lhs, const Member& rhs) {
+        return lhs.first < rhs.first;
+      });
+      const auto last = unique(begin, members_.end(), [](const Member& lhs, const Member& rhs) {
+        return lhs.first == rhs.first;
+      });
+      const size_t size = last - begin;
+      const Value result(Object(arena.Copy(members_.data() + first, size), size));
+      members_.resize(first);
+      return result;
+    }
+    case '"':
+      return Value(Keep(ReadStringView(string_storage_), arena));
+    case 't':
+    case 'f':
+      return Value(ReadBool());
+    default:
+      return visit([](auto number) { return Value(number); }, ReadAnyNumber());
+  }
+}
+
+string_view Reader::Keep(string_view text, Arena& arena) const {
+  if (text.data() >= begin_ && text.data() < end_) {
+    return text;
+  }
+  return arena.Copy(text);
+}
+
+void Reader::SkipValue() {
+  switch (Peek()) {
+    case '[':
+      ReadArray([this] { SkipValue(); });
+      break;
+    case '{':
+      ReadObject([this](string_view) { SkipValue(); });
+      break;
+    case '"':
+      ReadStringView(string_storage_);
+      break;
+    case 't':
+    case 'f':
+      ReadBool();
+      break;
+    default:
+      ReadNumber();
+  }
+}
+
+string Reader::ReadString() {
+  return string(ReadStringView(string_storage_));
+}
+
+void Reader::SkipPlainChars() {
+  while (pos_ != end_ && *pos_ != '"' && *pos_ != '\\') {
+    ++pos_;
+  }
+  if (pos_ == end_) {
+    Fail("unterminated string");
+  }
+}
+
+string_view Reader::ReadStringView(string& storage) {
+  Expect('"');
+  const char* start = pos_;
+  // The closing quote is the last one before the next offset, only
+  // strings with escapes are scanned
+  if (indexed_) {
+    const uint32_t* const next = next_structural_ + 1;
+    const char* close =
+        next != structurals_.data() + structurals_.size() ? begin_ + *next : end_;
+    while (*--close != '"') {
+    }
+    if (!memchr(start, '\\', close - start)) {
+      pos_ = close + 1;
+      return {start, static_cast<size_t>(close - start)};
+    }
+  }
+  SkipPlainChars();
+  // Strings without escapes are not copied at all
+  if (*pos_ == '"') {
+    ++pos_;
+    return {start, static_cast<size_t>(pos_ - 1 - start)};
+  }
+  storage.assign(start, pos_);
+  while (*pos_ != '"') {
+    ++pos_;
+    if (pos_ == end_) {
+      Fail("unterminated string");
+    }
+    switch (*pos_++) {
+      case '"': storage += '"'; break;
+      case '\\': storage += '\\'; break;
+      case '/': storage += '/'; break;
+      case 'b': storage += '\b'; break;
+      case 'f': storage += '\f'; break;
+      case 'n': storage += '\n'; break;
+      case 'r': storage += '\r'; break;
+      case 't': storage += '\t'; break;
+      case 'u': AppendUtf8(storage, ReadCodePoint()); break;
+      default: --pos_; Fail("unknown escape");
+    }
+    start = pos_;
+    SkipPlainChars();
+    storage.append(start, pos_);
+  }
+  ++pos_;
+  return storage;
+}
+
+uint32_t Reader::ReadHex4() {
+  if (end_ - pos_ < 4) {
+    Fail("truncated \\u escape");
+  }
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i, ++pos_) {
+    const char c = *pos_;
+    value <<= 4;
+    if (c >= '0' && c <= '9') {
+      value |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      value |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      value |= c - 'A' + 10;
+    } else {
+      Fail("bad hex digit in \\u escape");
+    }
+  }
+  return value;
+}
+
+// Characters outside the basic plane come as a pair of surrogates
+uint32_t Reader::ReadCodePoint() {
+  const uint32_t high = ReadHex4();
+  if (high < 0xD800 || high > 0xDFFF) {
+    return high;
+  }
+  if (high > 0xDBFF || end_ - pos_ < 2 || pos_[0] != '\\' || pos_[1] != 'u') {
+    Fail("unpaired surrogate in \\u escape");
+  }
+  pos_ += 2;
+  const uint32_t low = ReadHex4();
+  if (low < 0xDC00 || low > 0xDFFF) {
+    Fail("unpaired surrogate in \\u escape");
+  }
+  return 0x10000 + ((high - 0xD800) << 10) + (low - 0xDC00);
+}
+
+bool Reader::ReadBool() {
+  const bool value = Peek() == 't';
+  const string_view literal = value ? "true" : "false";
+  if (static_cast<size_t>(end_ - pos_) < literal.size() ||
+      string_view(pos_, literal.size()) != literal) {
+    Fail("unknown literal");
+  }
+  pos_ += literal.size();
+  CheckScalarEnd();
+  return value;
+}
+
+double Reader::ReadNumber() {
+  return visit([](auto number) { return static_cast<double>(number); }, ReadAnyNumber());
+}
+
+// Digits are gathered while the grammar is checked. Up to 19 of them
+// cannot overflow, and a mantissa below 2^53 with a power of ten up to
+// 1e22 is exact, so one rounded operation gives the nearest double.
+// Anything else goes to from_chars
+variant<size_t, double> Reader::ReadAnyNumber() {
+  Peek();
+  const char* const start = pos_;
+  const bool negative = *pos_ == '-';
+  if (negative) {
+    ++pos_;
+  }
+  if (!IsDigit()) {
+    Fail("unexpected character");
+  }
+  uint64_t mantissa = 0;
+  const char* digits_start = pos_;
+  while (IsDigit()) {
+    mantissa = mantissa * 10 + static_cast<uint64_t>(*pos_++ - '0');
+  }
+  size_t digits = pos_ - digits_start;
+  int exponent = 0;
+  bool integer = !negative;
+  if (pos_ != end_ && *pos_ == '.') {
+    integer = false;
+    digits_start = ++pos_;
+    if (!IsDigit()) {
+      Fail("missing fraction digits");
+    }
+    while (IsDigit()) {
+      mantissa = mantissa * 10 + static_cast<uint64_t>(*pos_++ - '0');
+    }
+    digits += pos_ - digits_start;
+    exponent = -static_cast<int>(pos_ - digits_start);
+  }
+  if (pos_ != end_ && (*pos_ == 'e' || *pos_ == 'E')) {
+    integer = false;
+    ++pos_;
+    bool negative_exponent = false;
+    if (pos_ != end_ && (*pos_ == '-' || *pos_ == '+')) {
+      negative_exponent = *pos_++ == '-';
+    }
+    if (!IsDigit()) {
+      Fail("missing exponent digits");
+    }
+    int value = 0;
+    while (IsDigit()) {
+      value = min(value * 10 + (*pos_++ - '0'), 9999);
+    }
+    exponent += negative_exponent ? -value : value;
+  }
+  CheckScalarEnd();
+
+  if (digits <= 19) {
+    if (integer) {
+      return static_cast<size_t>(mantissa);
+    }
+    if (mantissa <= (uint64_t{1} << 53) && exponent >= -22 && exponent <= 22) {
+      double result = static_cast<double>(mantissa);
+      result = exponent < 0 ? result / kPowers[-exponent] : result * kPowers[exponent];
+      return negative ? -result : result;
+    }
+    if (const auto result = DecimalToDouble(mantissa, exponent, negative)) {
+      return *result;
+    }
+  }
+  return ParseNumber({start, static_cast<size_t>(pos_ - start)}, integer);
+}
+
+Document Load(string_view text) {
+  Reader reader(text);
+  Document document{reader.ReadNode()};
+  reader.Finish();
+  return document;
+}
+
+Document LoadFile(const string& path) {
+  const utility::MappedFile file(path);
+  return Load(file.GetView());
+}
 
 //-------------------------------------------------------------------
-// Print Node
+// Arena tree
 
-void ToJson(const Node& node, std::ostream& out, uint32_t lvl) {
-  if (std::holds_alternative<std::vector<Node>>(node)) {
-    ToJson(node.AsArray(), out, lvl);
-  } else if (std::holds_alternative<std::string>(node)) {
-    ToJson(node.AsString(), out, lvl);
-  } else if (std::holds_alternative<std::map<std::string, Node>>(node)) {
-    ToJson(node.AsMap(), out, lvl);
-  } else if (std::holds_alternative<double>(node)) {
-    ToJson(node.AsDouble(), out, lvl);
-  } else if (std::holds_alternative<size_t>(node)) {
-    ToJson(node.AsInt(), out, lvl);
+static_assert(sizeof(Value) == 16);
+static_assert(std::is_trivially_copyable_v<Value>);
+
+void* Arena::Allocate(size_t size, size_t alignment) {
+  auto aligned = [alignment](std::byte* pointer) {
+    const auto address = reinterpret_cast<uintptr_t>(pointer);
+    return pointer + ((alignment - address % alignment) % alignment);
+  };
+  if (!pos_ || static_cast<size_t>(end_ - aligned(pos_)) < size) {
+    // Blocks grow twice, so a tree takes a logarithmic number of them
+    const size_t previous = blocks_.empty() ? 0 : blocks_.back().size;
+    const size_t block_size = max({kMinBlockSize, 2 * previous, size + alignment});
+    blocks_.push_back({make_unique<std::byte[]>(block_size), block_size});
+    pos_ = blocks_.back().data.get();
+    end_ = pos_ + block_size;
+  }
+  std::byte* result = aligned(pos_);
+  pos_ = result + size;
+  return result;
+}
+
+string_view Arena::Copy(string_view text) {
+  return {Copy(text.data(), text.size()), text.size()};
+}
+
+void Arena::Clear() noexcept {
+  if (blocks_.empty()) {
+    return;
+  }
+  if (blocks_.size() > 1) {
+    Block last = move(blocks_.back());
+    blocks_.clear();
+    blocks_.push_back(move(last));
+  }
+  pos_ = blocks_.back().data.get();
+  end_ = pos_ + blocks_.back().size;
+}
+
+Object::const_iterator Object::find(string_view key) const noexcept {
+  if (size_ <= kLinearSearchSize) {
+    for (auto it = begin(); it != end(); ++it) {
+      if (it->first == key) {
+        return it;
+      }
+    }
+    return end();
+  }
+  auto it = lower_bound(begin(), end(), key, [](const Member& member, string_view value) {
+    return member.first < value;
+  });
+  return it != end() && it->first == key ? it : end();
+}
+
+const Value& Object::at(string_view key) const {
+  const auto it = find(key);
+  if (it == end()) {
+    throw out_of_range("Json: no key " + string(key));
+  }
+  return it->second;
+}
+
+uint32_t Value::Narrow(size_t size) {
+  if (size > UINT32_MAX) {
+    throw runtime_error("Json: value is too large");
+  }
+  return static_cast<uint32_t>(size);
+}
+
+size_t Value::AsIntegral() const {
+  if (kind_ == Kind::INTEGER) {
+    return integer_;
+  }
+  Check(Kind::NUMBER);
+  // 2^64, doubles below it fit size_t
+  if (!(number_ >= 0 && number_ < 18446744073709551616.0) ||
+      number_ != std::floor(number_)) {
+    throw runtime_error("Json: number is not a non-negative integer");
+  }
+  return static_cast<size_t>(number_);
+}
+
+void Value::Check(Kind kind) const {
+  if (kind_ != kind) {
+    throw runtime_error("Json: value is of another kind");
+  }
+}
+
+ValueDocument::ValueDocument(Arena arena, Value root)
+    : arena_(move(arena)), root_(root) {
+}
+
+const Value& ValueDocument::GetRoot() const {
+  return root_;
+}
+
+ValueDocument LoadValues(string_view text) {
+  Arena arena;
+  Reader reader(text);
+  const Value root = reader.ReadValue(arena);
+  reader.Finish();
+  return ValueDocument{move(arena), root};
+}
+
+
+//-------------------------------------------------------------------
+// Writer
+
+namespace {
+
+constexpr string_view kSpaces = "                                ";
+
+// Shortest text reading back as the same double, JSON has no infinities
+string_view FormatNumber(double value, char (&buffer)[32]) {
+  if (!isfinite(value)) {
+    return "null";
+  }
+  const auto result = to_chars(std::begin(buffer), std::end(buffer), value);
+  return {buffer, static_cast<size_t>(result.ptr - buffer)};
+}
+
+template <typename Int>
+string_view FormatInteger(Int value, char (&buffer)[32]) {
+  const auto result = to_chars(std::begin(buffer), std::end(buffer), value);
+  return {buffer, static_cast<size_t>(result.ptr - buffer)};
+}
+
+// Quotes, backslashes and control characters are escaped, the rest is
+// copied as is in runs
+void AppendEscaped(string& out, string_view text) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out += '"';
+  size_t plain = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    const auto c = static_cast<unsigned char>(text[i]);
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    out.append(text, plain, i - plain);
+    plain = i + 1;
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        out += "\\u00";
+        out += kHex[c >> 4];
+        out += kHex[c & 0xF];
+    }
+  }
+  out.append(text, plain);
+  out += '"';
+}
+
+}  // namespace
+
+Writer::Writer(ostream& out, bool compact, uint32_t lvl)
+    : out_(out), compact_(compact), lvl_(lvl) {
+  buffer_.reserve(kChunkSize + 1024);
+}
+
+Writer::~Writer() {
+  Flush();
+}
+
+void Writer::Flush() {
+  out_.write(buffer_.data(), static_cast<streamsize>(buffer_.size()));
+  buffer_.clear();
+}
+
+void Writer::Indent(size_t lvl) {
+  for (; lvl > kSpaces.size(); lvl -= kSpaces.size()) {
+    buffer_ += kSpaces;
+  }
+  buffer_.append(kSpaces.substr(0, lvl));
+}
+
+// Before a member or an element of the innermost container
+void Writer::Separate() {
+  if (compact_) {
+    if (!empty_.back()) {
+      buffer_ += ',';
+    }
+  } else {
+    buffer_ += empty_.back() ? "\n" : ",\n";
+    Indent(lvl_ + 2 * empty_.size());
+  }
+  empty_.back() = false;
+}
+
+void Writer::BeforeValue() {
+  if (after_key_) {
+    after_key_ = false;
+  } else if (!empty_.empty()) {
+    Separate();
+  }
+}
+
+void Writer::Close(char bracket) {
+  if (empty_.empty()) {
+    throw logic_error("Json: no container to close");
+  }
+  const bool empty = empty_.back();
+  empty_.pop_back();
+  if (!compact_ && !empty) {
+    buffer_ += '\n';
+    Indent(lvl_ + 2 * empty_.size());
+  }
+  buffer_ += bracket;
+  FlushIfFull();
+}
+
+void Writer::StartArray() {
+  BeforeValue();
+  buffer_ += '[';
+  empty_.push_back(true);
+}
+
+void Writer::EndArray() {
+  Close(']');
+}
+
+void Writer::StartObject() {
+  BeforeValue();
+  buffer_ += '{';
+  empty_.push_back(true);
+}
+
+void Writer::EndObject() {
+  Close('}');
+}
+
+void Writer::Key(string_view key) {
+  if (empty_.empty()) {
+    throw logic_error("Json: key outside of an object");
+  }
+  Separate();
+  AppendEscaped(buffer_, key);
+  buffer_ += compact_ ? ":" : ": ";
+  after_key_ = true;
+}
+
+void Writer::String(string_view value) {
+  BeforeValue();
+  AppendEscaped(buffer_, value);
+  FlushIfFull();
+}
+
+void Writer::Number(double value) {
+  BeforeValue();
+  char buffer[32];
+  buffer_ += FormatNumber(value, buffer);
+  FlushIfFull();
+}
+
+void Writer::Integer(uint64_t value) {
+  BeforeValue();
+  char buffer[32];
+  buffer_ += FormatInteger(value, buffer);
+  FlushIfFull();
+}
+
+void Writer::Bool(bool value) {
+  BeforeValue();
+  buffer_ += value ? "true" : "false";
+  FlushIfFull();
+}
+
+void Writer::Write(const Node& node) {
+  if (holds_alternative<vector<Node>>(node)) {
+    StartArray();
+    for (const Node& element : node.AsArray()) {
+      Write(element);
+    }
+    EndArray();
+  } else if (holds_alternative<map<string, Node>>(node)) {
+    StartObject();
+    for (const auto& [key, member] : node.AsMap()) {
+      Key(key);
+      Write(member);
+    }
+    EndObject();
+  } else if (holds_alternative<string>(node)) {
+    String(node.AsString());
+  } else if (holds_alternative<double>(node)) {
+    Number(node.AsDouble());
+  } else if (holds_alternative<size_t>(node)) {
+    Integer(node.AsInt());
   } else {
-    ToJson(node.AsBool(), out, lvl);
+    Bool(node.AsBool());
+  }
+}
+
+void Writer::Write(const Value& value) {
+  switch (value.GetKind()) {
+    case Value::Kind::ARRAY:
+      StartArray();
+      for (const Value& element : value.AsArray()) {
+        Write(element);
+      }
+      EndArray();
+      break;
+    case Value::Kind::OBJECT:
+      StartObject();
+      for (const auto& [key, member] : value.AsMap()) {
+        Key(key);
+        Write(member);
+      }
+      EndObject();
+      break;
+    case Value::Kind::STRING:
+      String(value.AsString());
+      break;
+    case Value::Kind::NUMBER:
+      Number(value.AsDouble());
+      break;
+    case Value::Kind::INTEGER:
+      Integer(value.AsInt());
+      break;
+    case Value::Kind::BOOL:
+      Bool(value.AsBool());
+      break;
   }
 }
 
+void PrintNumber(double value, ostream& out) {
+  char buffer[32];
+  const auto text = FormatNumber(value, buffer);
+  out.write(text.data(), static_cast<streamsize>(text.size()));
+}
+
+void PrintNumber(int64_t value, ostream& out) {
+  char buffer[32];
+  const auto text = FormatInteger(value, buffer);
+  out.write(text.data(), static_cast<streamsize>(text.size()));
+}
+
+void PrintNumber(uint64_t value, ostream& out) {
+  char buffer[32];
+  const auto text = FormatInteger(value, buffer);
+  out.write(text.data(), static_cast<streamsize>(text.size()));
+}
+
+//-------------------------------------------------------------------
+// Print Node
+
+void ToJson(const Node& node, std::ostream& out, uint32_t lvl) {
+  Writer(out, false, lvl).Write(node);
+}
+
+void ToJson(const Value& value, std::ostream& out, uint32_t lvl) {
+  Writer(out, false, lvl).Write(value);
+}
+
 //-------------------------------------------------------------------
 
 
@@ -145,17 +958,20 @@ void ToJson(bool value, std::ostream& out, uint32_t lvl) {
 }
 
 void ToJson(const std::string_view value, std::ostream& out, uint32_t lvl) {
-  out << '"' << value << '"';
+  string text;
+  AppendEscaped(text, value);
+  out << text;
 }
 
 void ToJson(const std::string& value, std::ostream& out, uint32_t lvl) {
-  out << '"' << value << '"';
+  ToJson(std::string_view(value), out, lvl);
 }
 
 void LeftWhiteSpace(uint32_t lvl, std::ostream& out) {
-  for (uint32_t i = 0; i < lvl; ++i) {
-    out << ' ';
+  for (; lvl > kSpaces.size(); lvl -= kSpaces.size()) {
+    out << kSpaces;
   }
+  out << kSpaces.substr(0, lvl);
 }
 
 }  // namespace Json
\ No newline at end of file
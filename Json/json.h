@@ -1,8 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <istream>
 #include <map>
+#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <variant>
 #include <vector>
 #include <type_traits>
@@ -13,7 +20,7 @@ namespace Json {
 
 class Node : private std::variant<std::vector<Node>, std::map<std::string, Node>,
                                    size_t, std::string, bool, double> {
-  friend void ToJson(const Node& node, std::ostream& out, uint32_t lvl);
+  friend class Writer;
 
  public:
   using variant::variant;
@@ -35,7 +42,11 @@ class Node : private std::variant<std::vector<Node>, std::map<std::string, Node>
     return std::get<bool>(*this);
   }
 
+  // Integers read as doubles too
   double AsDouble() const {
+    if (const auto* integer = std::get_if<size_t>(this)) {
+      return static_cast<double>(*integer);
+    }
     return std::get<double>(*this);
   }
 };
@@ -52,6 +63,410 @@ class Document {
 
 Document Load(std::istream& input);
 
+// Parses the whole text in place: JSON whitespace, string escapes and
+// exponents are accepted, anything after the root value is an error.
+// Numbers without sign, fraction and exponent that fit size_t become
+// integers, others are the nearest double.
+// Throws std::runtime_error with the offset of malformed input
+Document Load(std::string_view text);
+
+// Maps the file and parses it with Load(std::string_view)
+Document LoadFile(const std::string& path);
+
+//-------------------------------------------------------------------
+// Arena tree
+
+// Bump allocator: memory is handed out from blocks in order and released
+// all at once. Only for trivially destructible objects
+class Arena {
+ public:
+  Arena() = default;
+  Arena(Arena&&) noexcept = default;
+  Arena& operator=(Arena&&) noexcept = default;
+
+  template <typename T>
+  T* Copy(const T* values, size_t count);
+
+  std::string_view Copy(std::string_view text);
+
+  // Makes all memory free again, the largest block is kept for reuse
+  void Clear() noexcept;
+
+ private:
+  static constexpr size_t kMinBlockSize = 4096;
+
+  void* Allocate(size_t size, size_t alignment);
+
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  std::vector<Block> blocks_;
+  std::byte* pos_{nullptr};
+  std::byte* end_{nullptr};
+};
+
+class Object;
+class Value;
+using Member = std::pair<std::string_view, Value>;
+
+// Node of a tree in an arena, 16 bytes and trivially copyable. Strings
+// are views, containers are spans of arena memory. Accessors throw
+// std::runtime_error for a value of another kind
+class Value {
+ public:
+  // INTEGER is a number Load would make size_t, NUMBER any other number
+  enum class Kind : uint8_t { ARRAY, OBJECT, STRING, NUMBER, INTEGER, BOOL };
+
+  Value() : Value(std::span<const Value>()) {
+  }
+  explicit Value(std::span<const Value> array)
+      : kind_(Kind::ARRAY), size_(Narrow(array.size())), array_(array.data()) {
+  }
+  explicit Value(Object object);
+  explicit Value(std::string_view text)
+      : kind_(Kind::STRING), size_(Narrow(text.size())), chars_(text.data()) {
+  }
+  explicit Value(double number) : kind_(Kind::NUMBER), number_(number) {
+  }
+  explicit Value(size_t integer) : kind_(Kind::INTEGER), integer_(integer) {
+  }
+  explicit Value(bool flag) : kind_(Kind::BOOL), flag_(flag) {
+  }
+
+  [[nodiscard]] Kind GetKind() const noexcept {
+    return kind_;
+  }
+
+  [[nodiscard]] std::span<const Value> AsArray() const {
+    Check(Kind::ARRAY);
+    return {array_, size_};
+  }
+  [[nodiscard]] Object AsMap() const;
+  [[nodiscard]] std::string_view AsString() const {
+    Check(Kind::STRING);
+    return {chars_, size_};
+  }
+  // Integers read as doubles too
+  [[nodiscard]] double AsDouble() const {
+    if (kind_ == Kind::INTEGER) {
+      return static_cast<double>(integer_);
+    }
+    Check(Kind::NUMBER);
+    return number_;
+  }
+  [[nodiscard]] size_t AsInt() const {
+    Check(Kind::INTEGER);
+    return integer_;
+  }
+  // Integers and whole numbers written otherwise, e.g. 3000.0 or 3e3.
+  // Throws std::runtime_error for fractions, negative or too large numbers
+  [[nodiscard]] size_t AsIntegral() const;
+  [[nodiscard]] bool AsBool() const {
+    Check(Kind::BOOL);
+    return flag_;
+  }
+
+ private:
+  static uint32_t Narrow(size_t size);
+  void Check(Kind kind) const;
+
+  Kind kind_;
+  uint32_t size_{0};
+  union {
+    const Value* array_;
+    const Member* members_;
+    const char* chars_;
+    double number_;
+    size_t integer_;
+    bool flag_;
+  };
+};
+
+// Members sorted by key like in std::map, the first of repeated keys is
+// kept. Small objects are searched linearly, larger ones by bisection
+class Object {
+ public:
+  using const_iterator = const Member*;
+
+  Object() = default;
+  Object(const Member* members, size_t size) : members_(members), size_(size) {
+  }
+
+  [[nodiscard]] const_iterator begin() const noexcept {
+    return members_;
+  }
+  [[nodiscard]] const_iterator end() const noexcept {
+    return members_ + size_;
+  }
+  [[nodiscard]] size_t size() const noexcept {
+    return size_;
+  }
+  [[nodiscard]] bool empty() const noexcept {
+    return size_ == 0;
+  }
+
+  [[nodiscard]] const_iterator find(std::string_view key) const noexcept;
+  [[nodiscard]] size_t count(std::string_view key) const noexcept {
+    return find(key) != end();
+  }
+  // Throws std::out_of_range like std::map::at
+  [[nodiscard]] const Value& at(std::string_view key) const;
+
+ private:
+  static constexpr size_t kLinearSearchSize = 8;
+
+  const Member* members_{nullptr};
+  size_t size_{0};
+};
+
+inline Value::Value(Object object)
+    : kind_(Kind::OBJECT), size_(Narrow(object.size())), members_(object.begin()) {
+}
+
+inline Object Value::AsMap() const {
+  Check(Kind::OBJECT);
+  return {members_, size_};
+}
+
+// Tree of one text in its own arena. Strings without escapes are views
+// into the text, so the text has to outlive the document
+class ValueDocument {
+ public:
+  ValueDocument(Arena arena, Value root);
+
+  const Value& GetRoot() const;
+
+ private:
+  Arena arena_;
+  Value root_;
+};
+
+// Same grammar and the same values as Load(std::string_view), but every
+// node, key and decoded string is placed into one arena
+ValueDocument LoadValues(std::string_view text);
+
+void ToJson(const Value& value, std::ostream& out, uint32_t lvl = 0);
+
+//-------------------------------------------------------------------
+// Reader
+
+// Pull parser over a buffer, the grammar of Load(std::string_view).
+// Containers are walked with callbacks, and the callback decides for
+// every value whether to build a Node of it, read a scalar or skip it,
+// so large inputs are consumed without holding their whole tree
+class Reader {
+ public:
+  explicit Reader(std::string_view text);
+  // Jumps between the offsets of FindStructurals(text) instead of skipping
+  // whitespace byte by byte
+  Reader(std::string_view text, std::vector<uint32_t> structurals);
+
+  // Calls on_key(std::string_view key) for every member of the object,
+  // on_key must read or skip the value. The key is valid until on_key
+  // returns
+  template <typename OnKey>
+  void ReadObject(OnKey on_key);
+
+  // Calls on_element() for every element, it must read or skip it
+  template <typename OnElement>
+  void ReadArray(OnElement on_element);
+
+  // Texts of the elements of the next array, found by matching brackets
+  // in the index without reading them, so they can go to other readers.
+  // Those check the elements, this only checks the separators. Throws
+  // std::logic_error for readers without an index
+  std::vector<std::string_view> SplitArray();
+  // The same in order, passed to on_batch(std::span<const std::string_view>)
+  // by up to batch_size, only one batch of texts is kept at a time
+  template <typename OnBatch>
+  void SplitArray(size_t batch_size, OnBatch on_batch);
+
+  Node ReadNode();
+  // Keys and strings with escapes are copied into the arena
+  Value ReadValue(Arena& arena);
+  std::string ReadString();
+  // Integers are converted, see ReadAnyNumber
+  double ReadNumber();
+  bool ReadBool();
+  void SkipValue();
+
+  // Throws if anything but whitespace follows
+  void Finish();
+
+ private:
+  [[noreturn]] void Fail(const char* what) const;
+  void SkipSpaces() noexcept;
+  // Next significant character, end of input is an error
+  char Peek();
+  void Expect(char c);
+  [[nodiscard]] bool IsDigit() const noexcept;
+  uint32_t ReadHex4();
+  uint32_t ReadCodePoint();
+  // View into the buffer, or into storage if the string has escapes
+  std::string_view ReadStringView(std::string& storage);
+  // Moves pos_ to the next quote or backslash
+  void SkipPlainChars();
+  std::string_view Keep(std::string_view text, Arena& arena) const;
+
+  // Reads the opening bracket of an array to split, false if it is empty
+  bool StartSplit();
+  // Appends texts of up to max_count next elements, false after the last
+  bool SplitElements(std::vector<std::string_view>& elements, size_t max_count);
+
+  // Numbers and literals end at whitespace, a comma or a bracket
+  void CheckScalarEnd();
+  // size_t for integers as Load makes them, double otherwise
+  std::variant<size_t, double> ReadAnyNumber();
+
+  const char* const begin_;
+  const char* pos_;
+  const char* const end_;
+  // Empty without an index, otherwise the offsets and the first one not
+  // before pos_
+  std::vector<uint32_t> structurals_;
+  const uint32_t* next_structural_{nullptr};
+  const bool indexed_{false};
+  // Children of containers being read by ReadValue
+  std::vector<Value> elements_;
+  std::vector<Member> members_;
+  std::string string_storage_;
+};
+
+template <typename T>
+T* Arena::Copy(const T* values, size_t count) {
+  static_assert(std::is_trivially_destructible_v<T>);
+  if (count == 0) {
+    return nullptr;
+  }
+  T* result = static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+  std::uninitialized_copy(values, values + count, result);
+  return result;
+}
+
+template <typename OnKey>
+void Reader::ReadObject(OnKey on_key) {
+  Expect('{');
+  if (Peek() == '}') {
+    ++pos_;
+    return;
+  }
+  while (true) {
+    if (Peek() != '"') {
+      Fail("expected a key");
+    }
+    // Only keys with escapes are decoded here
+    std::string storage;
+    const std::string_view key = ReadStringView(storage);
+    Expect(':');
+    on_key(key);
+    const char c = Peek();
+    ++pos_;
+    if (c == '}') {
+      return;
+    }
+    if (c != ',') {
+      Fail("expected , or } in object");
+    }
+  }
+}
+
+template <typename OnBatch>
+void Reader::SplitArray(size_t batch_size, OnBatch on_batch) {
+  if (!StartSplit()) {
+    return;
+  }
+  batch_size = std::max<size_t>(batch_size, 1);
+  std::vector<std::string_view> batch;
+  batch.reserve(batch_size);
+  bool more = true;
+  while (more) {
+    batch.clear();
+    more = SplitElements(batch, batch_size);
+    on_batch(std::span<const std::string_view>(batch));
+  }
+}
+
+template <typename OnElement>
+void Reader::ReadArray(OnElement on_element) {
+  Expect('[');
+  if (Peek() == ']') {
+    ++pos_;
+    return;
+  }
+  while (true) {
+    on_element();
+    const char c = Peek();
+    ++pos_;
+    if (c == ']') {
+      return;
+    }
+    if (c != ',') {
+      Fail("expected , or ] in array");
+    }
+  }
+}
+
+//-------------------------------------------------------------------
+// Writer
+
+// Buffered output, the text goes to the stream in large chunks. Pretty
+// mode lays values out like ToJson always did, compact mode writes no
+// whitespace. Numbers are the shortest text reading back as the same
+// double, strings are escaped
+class Writer {
+ public:
+  explicit Writer(std::ostream& out, bool compact = false, uint32_t lvl = 0);
+  ~Writer();
+
+  Writer(const Writer&) = delete;
+  Writer& operator=(const Writer&) = delete;
+
+  void StartArray();
+  void EndArray();
+  void StartObject();
+  void EndObject();
+  // Every value in an object follows its key
+  void Key(std::string_view key);
+
+  void String(std::string_view value);
+  void Number(double value);
+  void Integer(uint64_t value);
+  void Bool(bool value);
+  void Write(const Node& node);
+  void Write(const Value& value);
+
+  // Hands the buffered text to the stream, the destructor does it too
+  void Flush();
+
+ private:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  void BeforeValue();
+  void Separate();
+  void Close(char bracket);
+  void Indent(size_t lvl);
+  void FlushIfFull() {
+    if (buffer_.size() >= kChunkSize) {
+      Flush();
+    }
+  }
+
+  std::ostream& out_;
+  const bool compact_;
+  const uint32_t lvl_;
+  std::string buffer_;
+  // For every open container: whether nothing is written into it yet
+  std::vector<bool> empty_;
+  bool after_key_{false};
+};
+
+// Locale independent, doubles are written as by Writer::Number
+void PrintNumber(double value, std::ostream& out);
+void PrintNumber(int64_t value, std::ostream& out);
+void PrintNumber(uint64_t value, std::ostream& out);
+
 void ToJson(const Node& node, std::ostream& out, uint32_t lvl = 0);
 
 template <typename Num, typename = std::enable_if_t<std::is_arithmetic_v<Num>>>
@@ -123,7 +538,13 @@ void ToJson(const std::vector<V>& array, std::ostream& out, uint32_t lvl) {
 
 template <typename Num, typename/* = std::enable_if_t<std::is_arithmetic_v<Num>>*/>
 void ToJson(Num num, std::ostream& out, uint32_t lvl) {
-  out << num;
+  if constexpr (std::is_floating_point_v<Num>) {
+    PrintNumber(static_cast<double>(num), out);
+  } else if constexpr (std::is_signed_v<Num>) {
+    PrintNumber(static_cast<int64_t>(num), out);
+  } else {
+    PrintNumber(static_cast<uint64_t>(num), out);
+  }
 }
 
 }  // namespace Json
\ No newline at end of file
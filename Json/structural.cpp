@@ -0,0 +1,268 @@
+#include "structural.h"
+
+#include <array>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define JSON_HAS_AVX2
+#define JSON_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_M_X64)
+#define JSON_HAS_AVX2
+#define JSON_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+using namespace std;
+
+namespace Json {
+
+namespace {
+
+constexpr size_t kBlockSize = 64;
+
+// One bit per byte of a block
+struct Masks {
+  uint64_t backslash = 0;
+  uint64_t quote = 0;
+  uint64_t op = 0;  // brackets, braces, colons and commas
+  uint64_t space = 0;
+};
+
+// Bit i becomes the xor of bits 0..i: ones from every opening quote up to
+// its closing quote
+uint64_t PrefixXor(uint64_t bits) noexcept {
+  bits ^= bits << 1;
+  bits ^= bits << 2;
+  bits ^= bits << 4;
+  bits ^= bits << 8;
+  bits ^= bits << 16;
+  bits ^= bits << 32;
+  return bits;
+}
+
+// Turns masks of consecutive blocks into structural bits, carrying what
+// the previous block ended with: an unpaired backslash, an open string or
+// an unfinished number or literal
+class BlockScanner {
+ public:
+  uint64_t Next(const Masks& masks) noexcept {
+    const uint64_t escaped = FindEscaped(masks.backslash);
+    const uint64_t quote = masks.quote & ~escaped;
+    const uint64_t in_string = PrefixXor(quote) ^ in_string_;
+    in_string_ = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+    // Inside of strings with their closing quotes
+    const uint64_t string_tail = in_string ^ quote;
+
+    // Only the first character of a number or literal is kept, opening
+    // quotes count as such starts too
+    const uint64_t scalar = ~(masks.op | masks.space);
+    const uint64_t plain_scalar = scalar & ~quote;
+    const uint64_t follows_scalar = (plain_scalar << 1) | scalar_;
+    scalar_ = plain_scalar >> 63;
+    return (masks.op | (scalar & ~follows_scalar)) & ~string_tail;
+  }
+
+  [[nodiscard]] bool InString() const noexcept {
+    return in_string_ != 0;
+  }
+
+ private:
+  // Characters following an odd number of backslashes. A run is split
+  // into pairs from its start, adding the starts of runs beginning at odd
+  // bits carries their ends to the other parity
+  uint64_t FindEscaped(uint64_t backslash) noexcept {
+    constexpr uint64_t kEvenBits = 0x5555555555555555ULL;
+    backslash &= ~escaped_;
+    const uint64_t follows_escape = (backslash << 1) | escaped_;
+    const uint64_t odd_starts = backslash & ~kEvenBits & ~follows_escape;
+    const uint64_t sum = odd_starts + backslash;
+    escaped_ = sum < odd_starts ? 1 : 0;
+    const uint64_t invert = sum << 1;
+    return (kEvenBits ^ invert) & follows_escape;
+  }
+
+  uint64_t escaped_ = 0;
+  uint64_t in_string_ = 0;
+  uint64_t scalar_ = 0;
+};
+
+// Offsets go straight into a vector sized ahead, a block adds up to 64
+class Output {
+ public:
+  explicit Output(size_t text_size) : offsets_(text_size / 4 + kBlockSize) {
+  }
+
+  void Append(uint32_t base, uint64_t bits) {
+    if (offsets_.size() - size_ < kBlockSize) {
+      offsets_.resize(offsets_.size() * 2);
+    }
+    uint32_t* out = offsets_.data() + size_;
+    size_ += popcount(bits);
+    // Four at a time with fewer mispredicted branches, writes past the
+    // last bit land in the reserved room
+    while (bits) {
+      for (int i = 0; i < 4; ++i) {
+        *out++ = base + static_cast<uint32_t>(countr_zero(bits));
+        bits &= bits - 1;
+      }
+    }
+  }
+
+  vector<uint32_t> Take() {
+    offsets_.resize(size_);
+    return move(offsets_);
+  }
+
+ private:
+  vector<uint32_t> offsets_;
+  size_t size_ = 0;
+};
+
+// Bits of kClasses entries
+constexpr uint8_t kBackslash = 1;
+constexpr uint8_t kQuote = 2;
+constexpr uint8_t kOp = 4;
+constexpr uint8_t kSpace = 8;
+
+constexpr auto kClasses = [] {
+  array<uint8_t, 256> classes{};
+  classes['\\'] = kBackslash;
+  classes['"'] = kQuote;
+  for (const unsigned char c : {'[', ']', '{', '}', ':', ','}) {
+    classes[c] = kOp;
+  }
+  for (const unsigned char c : {' ', '\t', '\n', '\r'}) {
+    classes[c] = kSpace;
+  }
+  return classes;
+}();
+
+Masks ClassifyScalar(const char* block) noexcept {
+  Masks masks;
+  for (size_t i = 0; i < kBlockSize; ++i) {
+    const uint8_t c = kClasses[static_cast<unsigned char>(block[i])];
+    masks.backslash |= static_cast<uint64_t>(c & kBackslash) << i;
+    masks.quote |= static_cast<uint64_t>((c & kQuote) >> 1) << i;
+    masks.op |= static_cast<uint64_t>((c & kOp) >> 2) << i;
+    masks.space |= static_cast<uint64_t>((c & kSpace) >> 3) << i;
+  }
+  return masks;
+}
+
+// The last block is copied and padded with spaces, they change nothing
+template <typename Classify>
+void ScanBlocks(string_view text, Classify classify, BlockScanner& scanner,
+                Output& output) {
+  size_t pos = 0;
+  for (; pos + kBlockSize <= text.size(); pos += kBlockSize) {
+    output.Append(static_cast<uint32_t>(pos), scanner.Next(classify(text.data() + pos)));
+  }
+  if (pos < text.size()) {
+    char block[kBlockSize];
+    memset(block, ' ', kBlockSize);
+    memcpy(block, text.data() + pos, text.size() - pos);
+    output.Append(static_cast<uint32_t>(pos), scanner.Next(classify(block)));
+  }
+}
+
+void ScanScalar(string_view text, BlockScanner& scanner, Output& output) {
+  ScanBlocks(text, [](const char* block) { return ClassifyScalar(block); }, scanner,
+             output);
+}
+
+#ifdef JSON_HAS_AVX2
+
+JSON_TARGET_AVX2 uint64_t Match(__m256i low, __m256i high, char c) noexcept {
+  const __m256i pattern = _mm256_set1_epi8(c);
+  const uint32_t low_bits =
+      static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, pattern)));
+  const uint32_t high_bits =
+      static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, pattern)));
+  return low_bits | (static_cast<uint64_t>(high_bits) << 32);
+}
+
+JSON_TARGET_AVX2 Masks ClassifyAvx2(const char* block) noexcept {
+  const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+  const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+  // Setting bit 5 turns [ and ] into { and }, and keeps , and :
+  const __m256i bit5 = _mm256_set1_epi8(0x20);
+  const __m256i low_folded = _mm256_or_si256(low, bit5);
+  const __m256i high_folded = _mm256_or_si256(high, bit5);
+
+  Masks masks;
+  masks.backslash = Match(low, high, '\\');
+  masks.quote = Match(low, high, '"');
+  masks.op = Match(low_folded, high_folded, '{') | Match(low_folded, high_folded, '}') |
+             Match(low, high, ',') | Match(low, high, ':');
+  masks.space = Match(low, high, ' ') | Match(low, high, '\n') |
+                Match(low, high, '\r') | Match(low, high, '\t');
+  return masks;
+}
+
+JSON_TARGET_AVX2 void ScanAvx2(string_view text, BlockScanner& scanner, Output& output) {
+  ScanBlocks(text, [](const char* block) { return ClassifyAvx2(block); }, scanner,
+             output);
+}
+
+ScanKernel DetectKernel() {
+#if defined(_M_X64) && !defined(__GNUC__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return ScanKernel::SCALAR;
+  }
+  // The system has to save the wide registers too
+  __cpuid(info, 1);
+  const bool has_avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) &&
+                       (_xgetbv(0) & 6) == 6;
+  __cpuidex(info, 7, 0);
+  return has_avx && (info[1] & (1 << 5)) ? ScanKernel::AVX2 : ScanKernel::SCALAR;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") ? ScanKernel::AVX2 : ScanKernel::SCALAR;
+#endif
+}
+
+#else
+
+ScanKernel DetectKernel() {
+  return ScanKernel::SCALAR;
+}
+
+#endif
+
+}  // namespace
+
+ScanKernel GetScanKernel() {
+  static const ScanKernel kernel = DetectKernel();
+  return kernel;
+}
+
+vector<uint32_t> FindStructurals(string_view text, ScanKernel kernel) {
+  if (text.size() > numeric_limits<uint32_t>::max()) {
+    throw runtime_error("Json: text is too long to index");
+  }
+  BlockScanner scanner;
+  Output output(text.size());
+#ifdef JSON_HAS_AVX2
+  // Kernels the processor lacks are never run
+  if (kernel == ScanKernel::AVX2 && GetScanKernel() == ScanKernel::AVX2) {
+    ScanAvx2(text, scanner, output);
+  } else {
+    ScanScalar(text, scanner, output);
+  }
+#else
+  ScanScalar(text, scanner, output);
+#endif
+  if (scanner.InString()) {
+    throw runtime_error("Json: unterminated string");
+  }
+  return output.Take();
+}
+
+}  // namespace Json
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace Json {
+
+// Stage one of parsing: offsets of every character a parser has to stop
+// at, found 64 bytes at a time without branching on the text. These are
+// brackets, braces, colons and commas outside strings, opening quotes,
+// and the first characters of numbers and literals. Whitespace and the
+// inside of strings never appear, so a parser can jump from one offset to
+// the next instead of looking at every byte
+enum class ScanKernel {
+  SCALAR,  // plain C++, runs everywhere
+  AVX2,    // 32 bytes per instruction, x86-64 only
+};
+
+// Fastest kernel the processor supports, checked once
+ScanKernel GetScanKernel();
+
+// Every kernel gives the same offsets. Throws std::runtime_error if a
+// string is not closed or the text does not fit uint32_t offsets
+std::vector<uint32_t> FindStructurals(std::string_view text,
+                                      ScanKernel kernel = GetScanKernel());
+
+}  // namespace Json
@@ -0,0 +1,237 @@
+#include "NamePool.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace bus {
+
+NamePool::NamePool(const Tables& tables)
+    : frozen_(!tables.seeds.empty()), seeds_(tables.seeds), slots_(tables.slots) {
+  CheckTables(tables);
+  if (!tables.chars.empty()) {
+    blocks_.push_back(std::make_unique<char[]>(tables.chars.size()));
+    std::memcpy(blocks_.back().get(), tables.chars.data(), tables.chars.size());
+  }
+  const char* data = blocks_.empty() ? nullptr : blocks_.back().get();
+  names_.reserve(tables.offsets.empty() ? 0 : tables.offsets.size() - 1);
+  for (size_t id = 0; id + 1 < tables.offsets.size(); ++id) {
+    const uint32_t begin = tables.offsets[id];
+    names_.emplace_back(data + begin, tables.offsets[id + 1] - begin);
+  }
+  if (!frozen_) {
+    for (NameId id = 0; id < names_.size(); ++id) {
+      ids_.insert({names_[id], id});
+    }
+  }
+}
+
+void NamePool::CheckTables(const Tables& tables) {
+  const auto& offsets = tables.offsets;
+  bool valid = !offsets.empty() && offsets.front() == 0 &&
+               offsets.back() == tables.chars.size() &&
+               std::is_sorted(offsets.begin(), offsets.end());
+  const size_t count = offsets.empty() ? 0 : offsets.size() - 1;
+  if (tables.seeds.empty()) {
+    valid = valid && tables.slots.empty();
+  } else {
+    valid = valid && tables.slots.size() == count &&
+            std::all_of(tables.slots.begin(), tables.slots.end(),
+                        [count](NameId id) { return id < count; }) &&
+            std::all_of(tables.seeds.begin(), tables.seeds.end(), [count](uint32_t seed) {
+              return !(seed & kDirectSlot) || (seed & ~kDirectSlot) < count;
+            });
+  }
+  if (!valid) {
+    throw std::runtime_error("Name tables are damaged");
+  }
+}
+
+NameId NamePool::Intern(std::string_view name) {
+  if (frozen_) {
+    if (auto id = Find(name)) {
+      return *id;
+    }
+    throw std::logic_error("Name pool is frozen");
+  }
+  if (auto it = ids_.find(name); it != ids_.end()) {
+    return it->second;
+  }
+  const auto id = static_cast<NameId>(names_.size());
+  const std::string_view stored = Store(name);
+  names_.push_back(stored);
+  ids_.insert({stored, id});
+  return id;
+}
+
+std::optional<NameId> NamePool::Find(std::string_view name) const {
+  if (frozen_) {
+    if (names_.empty()) {
+      return std::nullopt;
+    }
+    const NameId id = slots_[GetSlot(Hash(name))];
+    if (names_[id] != name) {
+      return std::nullopt;
+    }
+    return id;
+  }
+  if (auto it = ids_.find(name); it != ids_.end()) {
+    return it->second;
+  }
+  return std::nullopt;
+}
+
+std::string_view NamePool::Get(NameId id) const {
+  return names_.at(id);
+}
+
+size_t NamePool::Size() const noexcept {
+  return names_.size();
+}
+
+auto NamePool::GetTables() const -> Tables {
+  Tables tables;
+  tables.offsets.reserve(names_.size() + 1);
+  tables.offsets.push_back(0);
+  for (std::string_view name : names_) {
+    tables.chars.insert(tables.chars.end(), name.begin(), name.end());
+    tables.offsets.push_back(static_cast<uint32_t>(tables.chars.size()));
+  }
+  if (frozen_) {
+    tables.seeds = seeds_;
+    tables.slots = slots_;
+  }
+  return tables;
+}
+
+void NamePool::Freeze() {
+  if (frozen_) {
+    return;
+  }
+  // Keys with equal 64 bit hashes cannot be separated, the map stays then
+  if (BuildPerfectHash()) {
+    frozen_ = true;
+    ids_ = {};
+  }
+}
+
+bool NamePool::IsFrozen() const noexcept {
+  return frozen_;
+}
+
+bool NamePool::BuildPerfectHash() {
+  static constexpr size_t kBucketLoad = 4;
+  static constexpr uint32_t kMaxSeed = 1u << 16;
+  const size_t count = names_.size();
+  if (count >= kDirectSlot) {
+    return false;
+  }
+  const size_t bucket_count = count / kBucketLoad + 1;
+
+  std::vector<uint64_t> hashes(count);
+  std::vector<std::vector<NameId>> buckets(bucket_count);
+  for (NameId id = 0; id < count; ++id) {
+    hashes[id] = Hash(names_[id]);
+    buckets[Mix(hashes[id], 0) % bucket_count].push_back(id);
+  }
+
+  // Largest buckets are placed first while most slots are free
+  std::vector<uint32_t> order(bucket_count);
+  for (uint32_t i = 0; i < bucket_count; ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t lhs, uint32_t rhs) {
+    return buckets[lhs].size() > buckets[rhs].size();
+  });
+
+  std::vector<uint32_t> seeds(bucket_count, 0);
+  std::vector<NameId> slots(count);
+  std::vector<uint8_t> taken(count, 0);
+  std::vector<size_t> candidate;
+  size_t free_slot = 0;
+  for (uint32_t bucket : order) {
+    const auto& keys = buckets[bucket];
+    if (keys.empty()) {
+      break;
+    }
+    // Single keys come last and take whatever slot is left
+    if (keys.size() == 1) {
+      while (taken[free_slot]) {
+        ++free_slot;
+      }
+      taken[free_slot] = 1;
+      slots[free_slot] = keys[0];
+      seeds[bucket] = kDirectSlot | static_cast<uint32_t>(free_slot);
+      continue;
+    }
+    uint32_t seed = 1;
+    for (; seed < kMaxSeed; ++seed) {
+      candidate.clear();
+      for (NameId id : keys) {
+        const size_t slot = Mix(hashes[id], seed) % count;
+        if (taken[slot] ||
+            std::find(candidate.begin(), candidate.end(), slot) != candidate.end()) {
+          break;
+        }
+        candidate.push_back(slot);
+      }
+      if (candidate.size() == keys.size()) {
+        break;
+      }
+    }
+    if (seed == kMaxSeed) {
+      return false;
+    }
+    seeds[bucket] = seed;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      taken[candidate[i]] = 1;
+      slots[candidate[i]] = keys[i];
+    }
+  }
+
+  seeds_ = std::move(seeds);
+  slots_ = std::move(slots);
+  return true;
+}
+
+size_t NamePool::GetSlot(uint64_t hash) const noexcept {
+  const uint32_t seed = seeds_[Mix(hash, 0) % seeds_.size()];
+  if (seed & kDirectSlot) {
+    return seed & ~kDirectSlot;
+  }
+  return Mix(hash, seed) % slots_.size();
+}
+
+// FNV-1a, fixed across platforms unlike std::hash
+uint64_t NamePool::Hash(std::string_view name) noexcept {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : name) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// splitmix64 finalizer over hash and seed
+uint64_t NamePool::Mix(uint64_t hash, uint32_t seed) noexcept {
+  uint64_t x = hash + 0x9e3779b97f4a7c15ull * (static_cast<uint64_t>(seed) + 1);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+std::string_view NamePool::Store(std::string_view name) {
+  if (name.empty()) {
+    return {};
+  }
+  // Names longer than a block get a block of their own
+  if (block_used_ + name.size() > kBlockSize) {
+    blocks_.push_back(std::make_unique<char[]>(std::max(kBlockSize, name.size())));
+    block_used_ = 0;
+  }
+  char* data = blocks_.back().get() + block_used_;
+  std::memcpy(data, name.data(), name.size());
+  block_used_ += name.size();
+  return {data, name.size()};
+}
+
+}  // namespace bus
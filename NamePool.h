@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace bus {
+
+using NameId = uint32_t;
+
+// Append-only arena of stop and bus names. Every distinct name is stored
+// once and gets a dense id in order of appearance, views returned by the
+// pool stay valid for its whole lifetime, moves included.
+// Freeze replaces the hash map by a minimal perfect hash (hash and
+// displace): a lookup is one probe of each table and one string compare
+class NamePool {
+ public:
+  // Everything a pool is made of, e.g. to save it into a snapshot.
+  // Name id lives in chars [offsets[id], offsets[id + 1]), seeds and slots
+  // are the perfect hash and stay empty if the pool is not frozen
+  struct Tables {
+    std::vector<char> chars;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> seeds;
+    std::vector<NameId> slots;
+  };
+
+  NamePool() = default;
+  // Pool with the hash given, nothing is hashed again when it is frozen.
+  // Throws std::runtime_error if offsets or the hash point outside
+  explicit NamePool(const Tables& tables);
+  NamePool(const NamePool&) = delete;
+  NamePool& operator=(const NamePool&) = delete;
+  NamePool(NamePool&&) = default;
+  NamePool& operator=(NamePool&&) = default;
+
+  // Returns id of the name, copying it into the arena on first call.
+  // Throws std::logic_error for new names once the pool is frozen
+  NameId Intern(std::string_view name);
+
+  void Freeze();
+
+  [[nodiscard]] bool IsFrozen() const noexcept;
+
+  [[nodiscard]] std::optional<NameId> Find(std::string_view name) const;
+
+  // Throws std::out_of_range for ids not given by Intern
+  [[nodiscard]] std::string_view Get(NameId id) const;
+
+  [[nodiscard]] size_t Size() const noexcept;
+
+  [[nodiscard]] Tables GetTables() const;
+
+ private:
+  static constexpr size_t kBlockSize = 16 * 1024;
+  // Seed of a bucket with one key is the slot itself marked by this bit
+  static constexpr uint32_t kDirectSlot = 1u << 31;
+
+  static void CheckTables(const Tables& tables);
+
+  std::string_view Store(std::string_view name);
+
+  // Seeds are tried in order until keys of a bucket get free slots
+  bool BuildPerfectHash();
+  [[nodiscard]] size_t GetSlot(uint64_t hash) const noexcept;
+
+  static uint64_t Hash(std::string_view name) noexcept;
+  static uint64_t Mix(uint64_t hash, uint32_t seed) noexcept;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  size_t block_used_{kBlockSize};  // bytes taken in the last block
+  std::vector<std::string_view> names_;
+  std::unordered_map<std::string_view, NameId> ids_;
+
+  bool frozen_{false};
+  std::vector<uint32_t> seeds_;  // per bucket
+  std::vector<NameId> slots_;    // name id for every slot
+};
+
+}  // namespace bus
@@ -0,0 +1,63 @@
+#include "NetworkPublisher.h"
+#include <stdexcept>
+
+namespace bus {
+
+//-------------------------------------------------------------------
+// Reader
+
+NetworkPublisher::Reader::Reader(const NetworkPublisher& publisher)
+    : publisher_(publisher),
+      version_(publisher.GetVersion()),
+      snapshot_(publisher.Get()) {
+}
+
+const FrozenNetwork& NetworkPublisher::Reader::Get() {
+  const uint64_t version = publisher_.GetVersion();
+  if (version != version_) {
+    // A snapshot newer than the version may be taken here, then it is
+    // taken once more on the next call
+    snapshot_ = publisher_.Get();
+    version_ = version;
+  }
+  return *snapshot_;
+}
+
+uint64_t NetworkPublisher::Reader::GetVersion() const noexcept {
+  return version_;
+}
+
+//-------------------------------------------------------------------
+// NetworkPublisher
+
+NetworkPublisher::NetworkPublisher(ManagerFactory factory, Snapshot initial)
+    : factory_(std::move(factory)), current_(std::move(initial)) {
+  if (!current_.load()) {
+    throw std::invalid_argument("Publisher needs an initial network");
+  }
+}
+
+NetworkPublisher::Snapshot NetworkPublisher::Get() const {
+  return current_.load(std::memory_order_acquire);
+}
+
+uint64_t NetworkPublisher::GetVersion() const noexcept {
+  return version_.load(std::memory_order_acquire);
+}
+
+std::future<void> NetworkPublisher::Update(Delta delta) {
+  return std::async(std::launch::async,
+                    [this, delta = std::move(delta)] { Apply(delta); });
+}
+
+void NetworkPublisher::Apply(const Delta& delta) {
+  std::lock_guard lock(update_mutex_);
+  auto manager = factory_();
+  manager->Restore(*current_.load(std::memory_order_acquire));
+  delta(*manager);
+  // Snapshot goes first, so a reader seeing the new version finds it
+  current_.store(manager->Freeze(), std::memory_order_release);
+  version_.fetch_add(1, std::memory_order_release);
+}
+
+}  // namespace bus
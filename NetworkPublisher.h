@@ -0,0 +1,66 @@
+#pragma once
+#include "FrozenNetwork.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+namespace bus {
+
+// Keeps the current network snapshot and replaces it by a new one built in
+// background from the previous snapshot plus a batch of changes.
+// Queries which already took a snapshot finish on it, the old network is
+// released with its last reader.
+// Every update is a full rebuild: the previous snapshot is restored into a
+// fresh manager, the delta applied and everything frozen again, routers
+// included, so updates cost as much as the initial build. The request
+// processing of main answers a single frozen network and does not use it
+class NetworkPublisher {
+ public:
+  using Snapshot = std::shared_ptr<const FrozenNetwork>;
+  using Delta = std::function<void(BusManager&)>;
+  // Makes an empty manager with the routing settings of the network
+  using ManagerFactory = std::function<std::unique_ptr<BusManager>()>;
+
+  // Handle for one reader thread. Checks for a newer snapshot with a single
+  // atomic load and keeps the one it gave out until the next Get
+  class Reader {
+   public:
+    explicit Reader(const NetworkPublisher& publisher);
+
+    const FrozenNetwork& Get();
+
+    [[nodiscard]] uint64_t GetVersion() const noexcept;
+
+   private:
+    const NetworkPublisher& publisher_;
+    uint64_t version_;
+    Snapshot snapshot_;
+  };
+
+  NetworkPublisher(ManagerFactory factory, Snapshot initial);
+
+  [[nodiscard]] Snapshot Get() const;
+
+  // Number of snapshots published after the initial one
+  [[nodiscard]] uint64_t GetVersion() const noexcept;
+
+  // Builds the next snapshot on a separate thread, updates run one after
+  // another. An exception of delta or Freeze comes out of the future and
+  // leaves the current snapshot published
+  std::future<void> Update(Delta delta);
+
+ private:
+  void Apply(const Delta& delta);
+
+  ManagerFactory factory_;
+  std::atomic<Snapshot> current_;
+  std::atomic<uint64_t> version_{0};
+  // Taken by writers only
+  std::mutex update_mutex_;
+};
+
+}  // namespace bus
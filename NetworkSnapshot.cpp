@@ -0,0 +1,707 @@
+#include "NetworkSnapshot.h"
+#include "utility/mapped_file.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+
+namespace bus {
+
+namespace {
+
+static_assert(std::endian::native == std::endian::little,
+              "Snapshot records are stored in little endian order");
+
+using Router = BusManagerWithRouter::Router;
+using GraphEdge = Graph::Edge<utility::WeightWithSpan>;
+
+constexpr char kMagic[8] = {'B', 'U', 'S', 'N', 'E', 'T', 'S', 'N'};
+// Missing name
+constexpr uint32_t kNone = UINT32_MAX;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+  uint64_t payload_size;
+  uint64_t checksum;
+};
+
+struct SectionHeader {
+  uint32_t tag;
+  uint32_t record_size;
+  uint64_t count;
+};
+
+// Sections are written and read in this order
+enum class Section : uint32_t {
+  META = 1,
+  NAME_CHARS,
+  NAME_OFFSETS,
+  NAME_SEEDS,
+  NAME_SLOTS,
+  STOP_BY_NAME,
+  BUS_BY_NAME,
+  STOP_NAMES,
+  STOP_PLACES,
+  STOP_BUS_OFFSETS,
+  STOP_BUSES,
+  STOP_POSITIONS,
+  STOP_POSITION_BOUNDS,
+  STOP_NAME_RECORDS,
+  BUSES,
+  BUS_STOPS,
+  DISTANCE_OFFSETS,
+  DISTANCE_NEIGHBOURS,
+  TRIP_BUSES,
+  TRIP_OFFSETS,
+  TRIP_TIMES,
+  GRAPH_EDGES,
+  GRAPH_INCIDENCE_OFFSETS,
+  GRAPH_INCIDENCE_EDGES,
+  ROUTES,
+  PATTERN_OFFSETS,
+  PATTERN_STOPS,
+  PATTERN_DISTANCES,
+  PATTERN_BUSES,
+  PATTERN_STOP_OFFSETS,
+  STOP_PATTERNS,
+  CONNECTIONS,
+  CONNECTION_BUSES,
+};
+
+enum MetaFlags : uint32_t {
+  kHasGraph = 1,
+  kHasRaptor = 2,
+  kHasTimetable = 4,
+};
+
+struct Meta {
+  uint32_t algorithm;
+  uint32_t flags;
+  uint64_t vertex_count;
+  uint64_t raptor_stop_count;
+  double raptor_wait_time;
+  double raptor_velocity;
+  uint64_t timetable_stop_count;
+};
+
+struct BusEntry {
+  NameId name;
+  uint32_t type;
+  uint32_t first_stop;
+  uint32_t stop_count;
+  double route_length;
+  double geom_length;
+  uint64_t unique_stops;
+  uint64_t stops_on_route;
+};
+
+struct BoundsEntry {
+  SpatialIndex::Box bounds;
+  double min_cos_latitude;
+};
+
+// Records are copied byte by byte, so they must not have padding inside
+static_assert(sizeof(FileHeader) == 32);
+static_assert(sizeof(SectionHeader) == 16);
+static_assert(sizeof(Meta) == 48);
+static_assert(sizeof(BusEntry) == 48);
+static_assert(sizeof(BoundsEntry) == 40);
+static_assert(sizeof(GraphEdge) == 32);
+static_assert(sizeof(Router::RouteInternalData) == 24);
+static_assert(sizeof(SpatialIndex::Point) == 40);
+static_assert(sizeof(StopNameIndex::Record) == 8);
+static_assert(sizeof(Coordinates) == 16);
+static_assert(sizeof(RoadDistanceTable::Neighbour) == 8);
+static_assert(sizeof(RaptorRouter::StopPattern) == 8);
+static_assert(sizeof(Connection) == 32);
+
+// FNV-1a over 64 bit words, sections are padded to whole words
+uint64_t Checksum(const char* data, size_t size) noexcept {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    hash ^= word;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+NameId ToNameId(const NamePool& names, std::string_view name) {
+  if (name.empty()) {
+    return kNone;
+  }
+  auto id = names.Find(name);
+  if (!id) {
+    throw std::logic_error("Name " + std::string(name) +
+                           " is not in the pool of the network");
+  }
+  return *id;
+}
+
+std::string_view ToName(const NamePool& names, NameId id) {
+  return id == kNone ? std::string_view{} : names.Get(id);
+}
+
+template <typename T, typename Range>
+std::vector<T> Convert(const Range& values) {
+  return std::vector<T>(values.begin(), values.end());
+}
+
+//-------------------------------------------------------------------
+// Checks
+//
+// Every index read from a file is checked against the section it points
+// into before anything uses it, a damaged file gives an exception instead
+// of reads out of bounds
+
+void Check(bool valid, const char* what) {
+  if (!valid) {
+    throw std::runtime_error(std::string("Snapshot ") + what + " are damaged");
+  }
+}
+
+// Offsets of count ranges that cover total records one after another
+template <typename T>
+bool AreOffsets(std::span<const T> offsets, size_t count, size_t total) {
+  return offsets.size() == count + 1 && offsets.front() == 0 &&
+         offsets.back() == total && std::is_sorted(offsets.begin(), offsets.end());
+}
+
+template <typename T>
+bool AreBelow(std::span<const T> ids, size_t limit, T missing) {
+  return std::all_of(ids.begin(), ids.end(), [limit, missing](T id) {
+    return id < limit || id == missing;
+  });
+}
+
+template <typename T>
+bool AreBelow(std::span<const T> ids, size_t limit) {
+  return std::all_of(ids.begin(), ids.end(), [limit](T id) { return id < limit; });
+}
+
+// Routes from one vertex must lead back to it by their previous edges,
+// the route of the vertex to itself has none.
+// state: 0 not seen, 1 on the chain being walked, 2 leads to the source
+bool AreRoutesFrom(std::span<const Router::RouteInternalData> routes,
+                   std::span<const GraphEdge> edges, size_t from,
+                   std::vector<uint8_t>& state, std::vector<size_t>& chain) {
+  const size_t vertex_count = state.size();
+  if (routes[from * vertex_count + from].prev_edge != Router::kNoEdge) {
+    return false;
+  }
+  std::fill(state.begin(), state.end(), 0);
+  state[from] = 2;
+  for (size_t to = 0; to < vertex_count; ++to) {
+    if (routes[from * vertex_count + to].prev_edge == Router::kNoEdge) {
+      continue;
+    }
+    chain.clear();
+    size_t vertex = to;
+    while (state[vertex] == 0) {
+      const Graph::EdgeId edge = routes[from * vertex_count + vertex].prev_edge;
+      if (edge >= edges.size() || edges[edge].to != vertex) {
+        return false;
+      }
+      state[vertex] = 1;
+      chain.push_back(vertex);
+      vertex = edges[edge].from;
+    }
+    if (state[vertex] == 1) {
+      return false;
+    }
+    for (size_t on_chain : chain) {
+      state[on_chain] = 2;
+    }
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------
+// Writer
+
+class SnapshotWriter {
+ public:
+  template <typename T>
+  void Put(Section tag, const T* records, size_t count) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const SectionHeader header{static_cast<uint32_t>(tag), sizeof(T), count};
+    Append(&header, sizeof(header));
+    Append(records, sizeof(T) * count);
+    payload_.resize((payload_.size() + 7) / 8 * 8, '\0');
+    ++section_count_;
+  }
+
+  template <typename T>
+  void Put(Section tag, const std::vector<T>& records) {
+    Put(tag, records.data(), records.size());
+  }
+
+  void WriteTo(std::ostream& output) const {
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kSnapshotVersion;
+    header.section_count = section_count_;
+    header.payload_size = payload_.size();
+    header.checksum = Checksum(payload_.data(), payload_.size());
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(payload_.data(), payload_.size());
+  }
+
+ private:
+  void Append(const void* data, size_t size) {
+    payload_.append(static_cast<const char*>(data), size);
+  }
+
+  std::string payload_;
+  uint32_t section_count_{0};
+};
+
+//-------------------------------------------------------------------
+// Reader
+
+// Hands out sections of a mapped file in place, checks every section
+// is the expected one and fits into the file
+class SnapshotReader {
+ public:
+  SnapshotReader(const char* data, size_t size) {
+    FileHeader header;
+    if (size < sizeof(header)) {
+      throw std::runtime_error("Snapshot is truncated");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+      throw std::runtime_error("File is not a network snapshot");
+    }
+    if (header.version != kSnapshotVersion) {
+      throw std::runtime_error("Snapshot version " +
+                               std::to_string(header.version) +
+                               " is not supported");
+    }
+    if (header.payload_size != size - sizeof(header)) {
+      throw std::runtime_error("Snapshot is truncated");
+    }
+    pos_ = data + sizeof(header);
+    end_ = pos_ + header.payload_size;
+    if (Checksum(pos_, header.payload_size) != header.checksum) {
+      throw std::runtime_error("Snapshot checksum mismatch");
+    }
+  }
+
+  template <typename T>
+  std::span<const T> Take(Section tag) {
+    SectionHeader header;
+    if (static_cast<size_t>(end_ - pos_) < sizeof(header)) {
+      throw std::runtime_error("Snapshot is truncated");
+    }
+    std::memcpy(&header, pos_, sizeof(header));
+    pos_ += sizeof(header);
+    if (header.tag != static_cast<uint32_t>(tag) || header.record_size != sizeof(T)) {
+      throw std::runtime_error("Snapshot section " + std::to_string(header.tag) +
+                               " is not expected here");
+    }
+    if (header.count > static_cast<size_t>(end_ - pos_) / sizeof(T)) {
+      throw std::runtime_error("Snapshot is truncated");
+    }
+    // Sections start at 8 byte offsets of a page aligned mapping
+    std::span<const T> records(reinterpret_cast<const T*>(pos_), header.count);
+    pos_ += (records.size_bytes() + 7) / 8 * 8;
+    return records;
+  }
+
+  template <typename T>
+  std::vector<T> TakeVector(Section tag) {
+    auto records = Take<T>(tag);
+    return {records.begin(), records.end()};
+  }
+
+  template <typename T>
+  T TakeOne(Section tag) {
+    auto records = Take<T>(tag);
+    if (records.size() != 1) {
+      throw std::runtime_error("Snapshot section " +
+                               std::to_string(static_cast<uint32_t>(tag)) +
+                               " must hold one record");
+    }
+    return records[0];
+  }
+
+ private:
+  const char* pos_;
+  const char* end_;
+};
+
+}  // namespace
+
+//-------------------------------------------------------------------
+// Save
+
+void SaveSnapshot(const FrozenNetwork& network, std::ostream& output) {
+  const NetworkTables& tables = network.GetTables();
+  const NamePool& names = tables.names;
+  SnapshotWriter writer;
+
+  Meta meta{};
+  meta.algorithm = static_cast<uint32_t>(tables.algorithm);
+  if (tables.graph) {
+    meta.flags |= kHasGraph;
+    meta.vertex_count = tables.graph->GetVertexCount();
+  }
+  std::optional<RaptorRouter::Tables> raptor;
+  if (tables.raptor) {
+    meta.flags |= kHasRaptor;
+    raptor = tables.raptor->GetTables();
+    meta.raptor_stop_count = raptor->stop_count;
+    meta.raptor_wait_time = raptor->wait_time;
+    meta.raptor_velocity = raptor->velocity;
+  }
+  if (tables.timetable) {
+    meta.flags |= kHasTimetable;
+    meta.timetable_stop_count = tables.timetable->GetStopCount();
+  }
+  writer.Put(Section::META, &meta, 1);
+
+  const NamePool::Tables name_tables = names.GetTables();
+  writer.Put(Section::NAME_CHARS, name_tables.chars);
+  writer.Put(Section::NAME_OFFSETS, name_tables.offsets);
+  writer.Put(Section::NAME_SEEDS, name_tables.seeds);
+  writer.Put(Section::NAME_SLOTS, name_tables.slots);
+
+  writer.Put(Section::STOP_BY_NAME, tables.stop_by_name);
+  writer.Put(Section::BUS_BY_NAME, tables.bus_by_name);
+  writer.Put(Section::STOP_NAMES, tables.stop_names);
+  writer.Put(Section::STOP_PLACES, tables.stop_places);
+  writer.Put(Section::STOP_BUS_OFFSETS, tables.stop_bus_offsets);
+  writer.Put(Section::STOP_BUSES, tables.stop_buses);
+
+  const SpatialIndex::Tables positions = network.GetStopPositions().GetTables();
+  const BoundsEntry bounds{positions.bounds, positions.min_cos_latitude};
+  writer.Put(Section::STOP_POSITIONS, positions.points);
+  writer.Put(Section::STOP_POSITION_BOUNDS, &bounds, 1);
+  writer.Put(Section::STOP_NAME_RECORDS, network.GetStopNameIndex().GetRecords());
+
+  std::vector<BusEntry> buses;
+  buses.reserve(tables.buses.size());
+  for (const FrozenBus& bus : tables.buses) {
+    buses.push_back({bus.name, static_cast<uint32_t>(bus.type), bus.first_stop,
+                     bus.stop_count, bus.stats.route_length,
+                     bus.stats.geom_length, bus.stats.unique_stops,
+                     bus.stats.stops_on_route});
+  }
+  writer.Put(Section::BUSES, buses);
+  writer.Put(Section::BUS_STOPS, tables.bus_stops);
+
+  if (!tables.distances.IsFrozen()) {
+    throw std::logic_error("Road distances of a network are frozen");
+  }
+  writer.Put(Section::DISTANCE_OFFSETS, tables.distances.GetOffsets());
+  writer.Put(Section::DISTANCE_NEIGHBOURS, tables.distances.GetNeighbours());
+
+  std::vector<NameId> trip_buses;
+  std::vector<uint64_t> trip_offsets{0};
+  std::vector<double> trip_times;
+  for (const TripRecord& trip : tables.trips) {
+    trip_buses.push_back(ToNameId(names, trip.bus));
+    trip_times.insert(trip_times.end(), trip.times.begin(), trip.times.end());
+    trip_offsets.push_back(trip_times.size());
+  }
+  writer.Put(Section::TRIP_BUSES, trip_buses);
+  writer.Put(Section::TRIP_OFFSETS, trip_offsets);
+  writer.Put(Section::TRIP_TIMES, trip_times);
+
+  // Edges and routes refer to buses by name id, so they are written as
+  // they are in memory
+  std::vector<GraphEdge> edges;
+  std::vector<uint64_t> incidence_offsets;
+  std::vector<uint64_t> incidence_edges;
+  std::span<const Router::RouteInternalData> routes;
+  if (tables.graph) {
+    const auto& graph = *tables.graph;
+    edges.reserve(graph.GetEdgeCount());
+    for (Graph::EdgeId id = 0; id < graph.GetEdgeCount(); ++id) {
+      edges.push_back(graph.GetEdge(id));
+    }
+    incidence_offsets.push_back(0);
+    for (Graph::VertexId vertex = 0; vertex < graph.GetVertexCount(); ++vertex) {
+      for (Graph::EdgeId id : graph.GetIncidentEdges(vertex)) {
+        incidence_edges.push_back(id);
+      }
+      incidence_offsets.push_back(incidence_edges.size());
+    }
+    routes = network.GetRouter().GetRoutesInternalData();
+  }
+  writer.Put(Section::GRAPH_EDGES, edges);
+  writer.Put(Section::GRAPH_INCIDENCE_OFFSETS, incidence_offsets);
+  writer.Put(Section::GRAPH_INCIDENCE_EDGES, incidence_edges);
+  writer.Put(Section::ROUTES, routes.data(), routes.size());
+
+  if (!raptor) {
+    raptor.emplace();
+  }
+  std::vector<NameId> pattern_buses;
+  for (std::string_view bus : raptor->pattern_buses) {
+    pattern_buses.push_back(ToNameId(names, bus));
+  }
+  writer.Put(Section::PATTERN_OFFSETS, Convert<uint64_t>(raptor->pattern_offsets));
+  writer.Put(Section::PATTERN_STOPS, raptor->pattern_stops);
+  writer.Put(Section::PATTERN_DISTANCES, raptor->pattern_distances);
+  writer.Put(Section::PATTERN_BUSES, pattern_buses);
+  writer.Put(Section::PATTERN_STOP_OFFSETS, Convert<uint64_t>(raptor->stop_offsets));
+  writer.Put(Section::STOP_PATTERNS, raptor->stop_patterns);
+
+  std::vector<Connection> connections;
+  std::vector<NameId> connection_buses;
+  if (tables.timetable) {
+    connections = tables.timetable->GetConnections();
+    for (std::string_view bus : tables.timetable->GetTripBuses()) {
+      connection_buses.push_back(ToNameId(names, bus));
+    }
+  }
+  writer.Put(Section::CONNECTIONS, connections);
+  writer.Put(Section::CONNECTION_BUSES, connection_buses);
+
+  writer.WriteTo(output);
+}
+
+void SaveSnapshot(const FrozenNetwork& network, const std::string& path) {
+  std::ofstream output(path, std::ios::binary | std::ios::trunc);
+  if (!output) {
+    throw std::runtime_error("Cannot create snapshot " + path);
+  }
+  SaveSnapshot(network, output);
+  if (!output.flush()) {
+    throw std::runtime_error("Cannot write snapshot " + path);
+  }
+}
+
+//-------------------------------------------------------------------
+// Load
+
+// Sections are checked first and then copied as they are: names keep
+// their perfect hash, graph, routes and stop indexes their layout, so
+// nothing is hashed, sorted or computed again. Only bus names of trips and
+// routers turn from ids into views of the pool
+std::shared_ptr<const FrozenNetwork> LoadSnapshot(const std::string& path) {
+  const utility::MappedFile file(path);
+  SnapshotReader reader(file.GetData(), file.GetSize());
+  NetworkTables tables;
+
+  const auto meta = reader.TakeOne<Meta>(Section::META);
+  Check(meta.algorithm <= static_cast<uint32_t>(RoutingAlgorithm::TIMETABLE),
+        "settings");
+  tables.algorithm = static_cast<RoutingAlgorithm>(meta.algorithm);
+
+  // Views handed to the routers point into this pool, it keeps them valid
+  // when the tables are moved into the network
+  NamePool::Tables name_tables;
+  name_tables.chars = reader.TakeVector<char>(Section::NAME_CHARS);
+  name_tables.offsets = reader.TakeVector<uint32_t>(Section::NAME_OFFSETS);
+  name_tables.seeds = reader.TakeVector<uint32_t>(Section::NAME_SEEDS);
+  name_tables.slots = reader.TakeVector<NameId>(Section::NAME_SLOTS);
+  tables.names = NamePool(name_tables);
+  const NamePool& names = tables.names;
+  const size_t name_count = names.Size();
+
+  const auto stop_by_name = reader.Take<StopId>(Section::STOP_BY_NAME);
+  const auto bus_by_name = reader.Take<uint32_t>(Section::BUS_BY_NAME);
+  const auto stop_names = reader.Take<NameId>(Section::STOP_NAMES);
+  const auto stop_places = reader.Take<Coordinates>(Section::STOP_PLACES);
+  const auto stop_bus_offsets = reader.Take<uint32_t>(Section::STOP_BUS_OFFSETS);
+  const auto stop_buses = reader.Take<NameId>(Section::STOP_BUSES);
+  const auto positions = reader.Take<SpatialIndex::Point>(Section::STOP_POSITIONS);
+  const auto bounds = reader.TakeOne<BoundsEntry>(Section::STOP_POSITION_BOUNDS);
+  const auto name_records =
+      reader.Take<StopNameIndex::Record>(Section::STOP_NAME_RECORDS);
+  const auto buses = reader.Take<BusEntry>(Section::BUSES);
+  const auto bus_stops = reader.Take<StopId>(Section::BUS_STOPS);
+
+  const size_t stop_count = stop_names.size();
+  Check(AreBelow(stop_names, name_count) && stop_places.size() == stop_count &&
+            AreOffsets(stop_bus_offsets, stop_count, stop_buses.size()) &&
+            AreBelow(stop_buses, name_count),
+        "stops");
+  Check(stop_by_name.size() == name_count && bus_by_name.size() == name_count &&
+            AreBelow(stop_by_name, stop_count, NetworkTables::kNoRecord) &&
+            AreBelow(bus_by_name, buses.size(), NetworkTables::kNoRecord),
+        "name tables");
+  Check(positions.size() == stop_count &&
+            std::all_of(positions.begin(), positions.end(),
+                        [stop_count](const SpatialIndex::Point& point) {
+                          return point.stop < stop_count;
+                        }),
+        "stop positions");
+  Check(name_records.size() == stop_count &&
+            std::all_of(name_records.begin(), name_records.end(),
+                        [&](const StopNameIndex::Record& record) {
+                          return record.stop < stop_count &&
+                                 record.common_prefix <=
+                                     names.Get(stop_names[record.stop]).size();
+                        }),
+        "stop name records");
+  Check(std::all_of(buses.begin(), buses.end(),
+                    [&](const BusEntry& bus) {
+                      return bus.name < name_count && bus.type <= 1 &&
+                             uint64_t{bus.first_stop} + bus.stop_count <=
+                                 bus_stops.size();
+                    }) &&
+            AreBelow(bus_stops, stop_count),
+        "buses");
+
+  tables.stop_by_name = Convert<StopId>(stop_by_name);
+  tables.bus_by_name = Convert<uint32_t>(bus_by_name);
+  tables.stop_names = Convert<NameId>(stop_names);
+  tables.stop_places = Convert<Coordinates>(stop_places);
+  tables.stop_bus_offsets = Convert<uint32_t>(stop_bus_offsets);
+  tables.stop_buses = Convert<NameId>(stop_buses);
+  tables.stop_positions =
+      SpatialIndex::Tables{Convert<SpatialIndex::Point>(positions), bounds.bounds,
+                           bounds.min_cos_latitude};
+  tables.stop_name_records = Convert<StopNameIndex::Record>(name_records);
+  tables.buses.reserve(buses.size());
+  for (const BusEntry& bus : buses) {
+    tables.buses.push_back(
+        {bus.name, static_cast<BusRecord::RouteType>(bus.type),
+         BusStats{bus.route_length, bus.geom_length, bus.unique_stops,
+                  bus.stops_on_route},
+         bus.first_stop, bus.stop_count});
+  }
+  tables.bus_stops = Convert<StopId>(bus_stops);
+
+  auto distance_offsets = reader.TakeVector<uint32_t>(Section::DISTANCE_OFFSETS);
+  auto neighbours =
+      reader.TakeVector<RoadDistanceTable::Neighbour>(Section::DISTANCE_NEIGHBOURS);
+  Check(AreOffsets(std::span<const uint32_t>(distance_offsets), stop_count,
+                   neighbours.size()) &&
+            std::all_of(neighbours.begin(), neighbours.end(),
+                        [stop_count](const RoadDistanceTable::Neighbour& neighbour) {
+                          return neighbour.stop < stop_count;
+                        }),
+        "road distances");
+  tables.distances =
+      RoadDistanceTable(std::move(distance_offsets), std::move(neighbours));
+
+  const auto trip_buses = reader.Take<NameId>(Section::TRIP_BUSES);
+  const auto trip_offsets = reader.Take<uint64_t>(Section::TRIP_OFFSETS);
+  const auto trip_times = reader.Take<double>(Section::TRIP_TIMES);
+  Check(AreBelow(trip_buses, name_count, kNone) &&
+            AreOffsets(trip_offsets, trip_buses.size(), trip_times.size()),
+        "trips");
+  tables.trips.reserve(trip_buses.size());
+  for (size_t trip = 0; trip < trip_buses.size(); ++trip) {
+    tables.trips.push_back({ToName(names, trip_buses[trip]),
+                            {trip_times.begin() + trip_offsets[trip],
+                             trip_times.begin() + trip_offsets[trip + 1]}});
+  }
+
+  const auto edges = reader.Take<GraphEdge>(Section::GRAPH_EDGES);
+  const auto incidence_offsets = reader.Take<uint64_t>(Section::GRAPH_INCIDENCE_OFFSETS);
+  const auto incidence_edges = reader.Take<uint64_t>(Section::GRAPH_INCIDENCE_EDGES);
+  const auto routes = reader.Take<Router::RouteInternalData>(Section::ROUTES);
+  if (meta.flags & kHasGraph) {
+    const size_t vertex_count = meta.vertex_count;
+    Check(vertex_count == 2 * stop_count &&
+              std::all_of(edges.begin(), edges.end(),
+                          [&](const GraphEdge& edge) {
+                            return edge.from < vertex_count && edge.to < vertex_count &&
+                                   (edge.weight.route < name_count ||
+                                    edge.weight.route ==
+                                        utility::WeightWithSpan::kNoRoute);
+                          }) &&
+              AreOffsets(incidence_offsets, vertex_count, incidence_edges.size()),
+          "graph edges");
+    std::vector<Graph::DirectedWeightedGraph<utility::WeightWithSpan>::IncidenceList>
+        incidence_lists(vertex_count);
+    for (size_t vertex = 0; vertex < vertex_count; ++vertex) {
+      auto& list = incidence_lists[vertex];
+      list.assign(incidence_edges.begin() + incidence_offsets[vertex],
+                  incidence_edges.begin() + incidence_offsets[vertex + 1]);
+      Check(std::all_of(list.begin(), list.end(),
+                        [&](Graph::EdgeId id) {
+                          return id < edges.size() && edges[id].from == vertex;
+                        }),
+            "graph edges");
+    }
+
+    Check(routes.size() == vertex_count * vertex_count, "routes");
+    std::vector<uint8_t> state(vertex_count);
+    std::vector<size_t> chain;
+    for (size_t from = 0; from < vertex_count; ++from) {
+      Check(AreRoutesFrom(routes, edges, from, state, chain), "routes");
+    }
+    tables.graph.emplace(Convert<GraphEdge>(edges), std::move(incidence_lists));
+    tables.routes = Convert<Router::RouteInternalData>(routes);
+  }
+
+  RaptorRouter::Tables raptor;
+  raptor.stop_count = meta.raptor_stop_count;
+  raptor.wait_time = meta.raptor_wait_time;
+  raptor.velocity = meta.raptor_velocity;
+  const auto pattern_offsets = reader.Take<uint64_t>(Section::PATTERN_OFFSETS);
+  const auto pattern_stops = reader.Take<uint32_t>(Section::PATTERN_STOPS);
+  const auto pattern_distances = reader.Take<double>(Section::PATTERN_DISTANCES);
+  const auto pattern_buses = reader.Take<NameId>(Section::PATTERN_BUSES);
+  const auto stop_offsets = reader.Take<uint64_t>(Section::PATTERN_STOP_OFFSETS);
+  const auto stop_patterns =
+      reader.Take<RaptorRouter::StopPattern>(Section::STOP_PATTERNS);
+  if (meta.flags & kHasRaptor) {
+    const size_t pattern_count = pattern_buses.size();
+    Check(raptor.stop_count == stop_count &&
+              AreOffsets(pattern_offsets, pattern_count, pattern_stops.size()) &&
+              pattern_distances.size() == pattern_stops.size() &&
+              AreBelow(pattern_stops, stop_count) &&
+              AreBelow(pattern_buses, name_count) &&
+              AreOffsets(stop_offsets, stop_count, stop_patterns.size()) &&
+              std::all_of(stop_patterns.begin(), stop_patterns.end(),
+                          [&](const RaptorRouter::StopPattern& entry) {
+                            return entry.pattern < pattern_count &&
+                                   entry.idx < pattern_offsets[entry.pattern + 1] -
+                                                   pattern_offsets[entry.pattern];
+                          }),
+          "bus patterns");
+    raptor.pattern_offsets = Convert<size_t>(pattern_offsets);
+    raptor.pattern_stops = Convert<uint32_t>(pattern_stops);
+    raptor.pattern_distances = Convert<double>(pattern_distances);
+    for (NameId bus : pattern_buses) {
+      raptor.pattern_buses.push_back(names.Get(bus));
+    }
+    raptor.stop_offsets = Convert<size_t>(stop_offsets);
+    raptor.stop_patterns = Convert<RaptorRouter::StopPattern>(stop_patterns);
+    tables.raptor.emplace(std::move(raptor));
+  }
+
+  const auto connections = reader.Take<Connection>(Section::CONNECTIONS);
+  const auto connection_buses = reader.Take<NameId>(Section::CONNECTION_BUSES);
+  if (meta.flags & kHasTimetable) {
+    Check(meta.timetable_stop_count == stop_count &&
+              AreBelow(connection_buses, name_count, kNone) &&
+              std::all_of(connections.begin(), connections.end(),
+                          [&](const Connection& connection) {
+                            return connection.from_stop < stop_count &&
+                                   connection.to_stop < stop_count &&
+                                   connection.trip < connection_buses.size();
+                          }) &&
+              std::is_sorted(connections.begin(), connections.end(),
+                             [](const Connection& lhs, const Connection& rhs) {
+                               return lhs.departure < rhs.departure;
+                             }),
+          "connections");
+    std::vector<std::string_view> buses_of_trips;
+    buses_of_trips.reserve(connection_buses.size());
+    for (NameId bus : connection_buses) {
+      buses_of_trips.push_back(ToName(names, bus));
+    }
+    tables.timetable.emplace(stop_count, Convert<Connection>(connections),
+                             std::move(buses_of_trips));
+  }
+
+  return std::make_shared<const FrozenNetwork>(std::move(tables));
+}
+
+}  // namespace bus
@@ -0,0 +1,28 @@
+#pragma once
+#include "FrozenNetwork.h"
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace bus {
+
+// Binary image of a frozen network together with its routers.
+// A header with version and checksum is followed by flat arrays of
+// fixed-width records at 8 byte aligned offsets, names and edges are
+// referred to by ids, so nothing in the file depends on where it is mapped.
+// Records are stored in native (little endian) byte order
+inline constexpr uint32_t kSnapshotVersion = 2;
+
+void SaveSnapshot(const FrozenNetwork& network, std::ostream& output);
+
+void SaveSnapshot(const FrozenNetwork& network, const std::string& path);
+
+// Maps the file, checks every index against the section it points into
+// and copies the arrays as they are: names keep their hash, routes and stop
+// indexes are not computed again. Throws std::runtime_error for files of
+// another version, with wrong checksum or damaged sections
+std::shared_ptr<const FrozenNetwork> LoadSnapshot(const std::string& path);
+
+}  // namespace bus
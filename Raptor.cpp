@@ -0,0 +1,197 @@
+#include "Raptor.h"
+#include <algorithm>
+
+namespace bus {
+
+RaptorRouter::RaptorRouter(const std::vector<const BusRecord*>& buses,
+                           const StopArena& stops,
+                           const RoadDistanceTable& distances, double velocity,
+                           double wait_time)
+    : stop_count_(stops.size()), wait_time_(wait_time), velocity_(velocity) {
+  for (const BusRecord* bus : buses) {
+    const auto& bus_stops = bus->GetStops();
+    AddPattern(bus_stops.begin(), bus_stops.end(), bus->GetName(), stops,
+               distances);
+    if (bus->GetType() == BusRecord::RouteType::Linear) {
+      AddPattern(bus_stops.rbegin(), bus_stops.rend(), bus->GetName(), stops,
+                 distances);
+    }
+  }
+
+  // Build stop -> patterns incidence in CSR layout
+  stop_offsets_.assign(stop_count_ + 1, 0);
+  for (uint32_t stop : pattern_stops_) {
+    ++stop_offsets_[stop + 1];
+  }
+  for (size_t stop = 0; stop < stop_count_; ++stop) {
+    stop_offsets_[stop + 1] += stop_offsets_[stop];
+  }
+  stop_patterns_.resize(pattern_stops_.size());
+  std::vector<size_t> fill(stop_offsets_.begin(), stop_offsets_.end() - 1);
+  for (size_t pattern = 0; pattern + 1 < pattern_offsets_.size(); ++pattern) {
+    const size_t begin = pattern_offsets_[pattern];
+    for (size_t i = begin; i < pattern_offsets_[pattern + 1]; ++i) {
+      stop_patterns_[fill[pattern_stops_[i]]++] = {
+          static_cast<uint32_t>(pattern), static_cast<uint32_t>(i - begin)};
+    }
+  }
+}
+
+RaptorRouter::RaptorRouter(Tables tables)
+    : stop_count_(tables.stop_count),
+      wait_time_(tables.wait_time),
+      velocity_(tables.velocity),
+      pattern_offsets_(std::move(tables.pattern_offsets)),
+      pattern_stops_(std::move(tables.pattern_stops)),
+      pattern_distances_(std::move(tables.pattern_distances)),
+      pattern_buses_(std::move(tables.pattern_buses)),
+      stop_offsets_(std::move(tables.stop_offsets)),
+      stop_patterns_(std::move(tables.stop_patterns)) {
+}
+
+auto RaptorRouter::GetTables() const -> Tables {
+  return {stop_count_,       wait_time_,     velocity_,
+          pattern_offsets_,  pattern_stops_, pattern_distances_,
+          pattern_buses_,    stop_offsets_,  stop_patterns_};
+}
+
+template <typename Iter>
+void RaptorRouter::AddPattern(Iter begin, Iter end, std::string_view bus,
+                              const StopArena& stops,
+                              const RoadDistanceTable& distances) {
+  if (std::distance(begin, end) < 2) {
+    return;
+  }
+  double rolling_sum = 0.0;
+  for (auto it = begin; it != end; ++it) {
+    if (it != begin) {
+      rolling_sum += RouteDistance(stops, distances, *std::prev(it), *it);
+    }
+    pattern_stops_.push_back(*it);
+    pattern_distances_.push_back(rolling_sum);
+  }
+  pattern_offsets_.push_back(pattern_stops_.size());
+  pattern_buses_.push_back(bus);
+}
+
+std::optional<Journey> RaptorRouter::FindRoute(
+    size_t from, size_t to, Criterion criterion) const {
+  if (from >= stop_count_ || to >= stop_count_) {
+    return std::nullopt;
+  }
+  const size_t pattern_count = pattern_buses_.size();
+  static constexpr uint32_t kNotQueued = std::numeric_limits<uint32_t>::max();
+
+  std::vector<Round> rounds(1, Round(stop_count_));
+  rounds[0][from].time = 0;
+  std::vector<double> best(stop_count_, kInfinity);
+  best[from] = 0;
+  std::vector<uint8_t> marked(stop_count_, 0);
+  marked[from] = 1;
+  std::vector<uint32_t> queue(pattern_count, kNotQueued);
+  std::vector<size_t> touched;
+
+  while (!(criterion == Criterion::MIN_TRANSFERS && best[to] < kInfinity)) {
+    // Every pattern is scanned from the first stop improved in last round
+    touched.clear();
+    for (size_t stop = 0; stop < stop_count_; ++stop) {
+      if (!marked[stop]) {
+        continue;
+      }
+      marked[stop] = 0;
+      for (size_t i = stop_offsets_[stop]; i < stop_offsets_[stop + 1]; ++i) {
+        const auto [pattern, idx] = stop_patterns_[i];
+        if (queue[pattern] == kNotQueued) {
+          touched.push_back(pattern);
+        }
+        queue[pattern] = std::min(queue[pattern], idx);
+      }
+    }
+    if (touched.empty()) {
+      break;
+    }
+
+    Round next = rounds.back();
+    for (auto& label : next) {
+      label.pattern = kNoPattern;
+    }
+    rounds.push_back(std::move(next));
+    const Round& previous = rounds[rounds.size() - 2];
+    Round& current = rounds.back();
+
+    for (size_t pattern : touched) {
+      ScanPattern(pattern, queue[pattern], previous, current, best, to, marked);
+      queue[pattern] = kNotQueued;
+    }
+  }
+
+  if (best[to] == kInfinity) {
+    return std::nullopt;
+  }
+  return Reconstruct(rounds, rounds.size() - 1, to);
+}
+
+void RaptorRouter::ScanPattern(size_t pattern, uint32_t first_idx,
+                               const Round& previous, Round& current,
+                               std::vector<double>& best, size_t target,
+                               std::vector<uint8_t>& marked) const {
+  const size_t begin = pattern_offsets_[pattern];
+  const size_t count = pattern_offsets_[pattern + 1] - begin;
+  const uint32_t* stops = pattern_stops_.data() + begin;
+  const double* distances = pattern_distances_.data() + begin;
+
+  // Departure cost of the best boarding stop seen so far, shifted by
+  // its distance so that comparison between candidates is a subtraction
+  double boarded_key = kInfinity;
+  uint32_t board_idx = 0;
+
+  for (uint32_t i = first_idx; i < count; ++i) {
+    const uint32_t stop = stops[i];
+    if (boarded_key < kInfinity) {
+      const double arrival =
+          previous[stops[board_idx]].time + wait_time_ +
+          (distances[i] - distances[board_idx]) / velocity_;
+      if (arrival < best[stop] && arrival < best[target]) {
+        current[stop] = {arrival, pattern, board_idx, i};
+        best[stop] = arrival;
+        marked[stop] = 1;
+      }
+    }
+
+    const double ready = previous[stop].time;
+    if (ready < kInfinity) {
+      const double key = ready - distances[i] / velocity_;
+      if (key < boarded_key) {
+        boarded_key = key;
+        board_idx = i;
+      }
+    }
+  }
+}
+
+Journey RaptorRouter::Reconstruct(
+    const std::vector<Round>& rounds, size_t round, size_t target) const {
+  Journey journey;
+  journey.total_time = rounds[round][target].time;
+
+  size_t stop = target;
+  while (round > 0) {
+    const Label& label = rounds[round--][stop];
+    if (label.pattern == kNoPattern) {
+      continue;
+    }
+    const size_t begin = pattern_offsets_[label.pattern];
+    const size_t board_stop = pattern_stops_[begin + label.board_idx];
+    journey.legs.push_back(
+        {board_stop, pattern_buses_[label.pattern],
+         label.alight_idx - label.board_idx, wait_time_,
+         (pattern_distances_[begin + label.alight_idx] -
+          pattern_distances_[begin + label.board_idx]) /
+             velocity_});
+    stop = board_stop;
+  }
+  std::reverse(journey.legs.begin(), journey.legs.end());
+  return journey;
+}
+
+}  // namespace bus
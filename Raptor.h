@@ -0,0 +1,96 @@
+#pragma once
+#include "BusManager.h"
+#include "Journey.h"
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace bus {
+
+// Round-based router working directly on bus stop sequences.
+// Buses are frequency based: every boarding costs wait_time and the ride
+// between two stops takes road distance / velocity.
+// Round k finds the fastest arrivals using exactly k buses, so the answer
+// with the least amount of transfers comes out of the same search.
+class RaptorRouter {
+ public:
+  enum class Criterion { FASTEST, MIN_TRANSFERS };
+
+  struct StopPattern {
+    uint32_t pattern;
+    uint32_t idx;
+  };
+
+  // Everything a router is made of, e.g. to save it into a snapshot
+  struct Tables {
+    size_t stop_count{0};
+    double wait_time{0};
+    double velocity{0};
+    std::vector<size_t> pattern_offsets;
+    std::vector<uint32_t> pattern_stops;
+    std::vector<double> pattern_distances;
+    std::vector<std::string_view> pattern_buses;
+    std::vector<size_t> stop_offsets;
+    std::vector<StopPattern> stop_patterns;
+  };
+
+  // velocity in metre per minute, buses must outlive the router
+  RaptorRouter(const std::vector<const BusRecord*>& buses,
+               const StopArena& stops, const RoadDistanceTable& distances,
+               double velocity, double wait_time);
+
+  // Names of the buses must outlive the router
+  explicit RaptorRouter(Tables tables);
+
+  [[nodiscard]] Tables GetTables() const;
+
+  [[nodiscard]] std::optional<Journey> FindRoute(
+      size_t from, size_t to, Criterion criterion = Criterion::FASTEST) const;
+
+ private:
+  static constexpr size_t kNoPattern = std::numeric_limits<size_t>::max();
+  static constexpr double kInfinity = std::numeric_limits<double>::infinity();
+
+  // Arrival at a stop after some round; pattern == kNoPattern means
+  // the label was carried over from the previous round
+  struct Label {
+    double time{kInfinity};
+    size_t pattern{kNoPattern};
+    uint32_t board_idx{0};
+    uint32_t alight_idx{0};
+  };
+  using Round = std::vector<Label>;
+
+  // Pattern is one direction of a bus: linear buses give two of them
+  template <typename Iter>
+  void AddPattern(Iter begin, Iter end, std::string_view bus,
+                  const StopArena& stops, const RoadDistanceTable& distances);
+
+  void ScanPattern(size_t pattern, uint32_t first_idx, const Round& previous,
+                   Round& current, std::vector<double>& best, size_t target,
+                   std::vector<uint8_t>& marked) const;
+
+  [[nodiscard]] Journey Reconstruct(const std::vector<Round>& rounds,
+                                    size_t round, size_t target) const;
+
+  size_t stop_count_;
+  double wait_time_;
+  double velocity_;
+
+  // Stops and cumulative road distances of pattern p live in
+  // [pattern_offsets_[p], pattern_offsets_[p + 1])
+  std::vector<size_t> pattern_offsets_{0};
+  std::vector<uint32_t> pattern_stops_;
+  std::vector<double> pattern_distances_;
+  std::vector<std::string_view> pattern_buses_;
+
+  // Patterns going through stop s with stop positions inside them live in
+  // [stop_offsets_[s], stop_offsets_[s + 1])
+  std::vector<size_t> stop_offsets_;
+  std::vector<StopPattern> stop_patterns_;
+};
+
+}  // namespace bus
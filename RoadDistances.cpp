@@ -0,0 +1,106 @@
+#include "RoadDistances.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace bus {
+
+RoadDistanceTable::RoadDistanceTable(std::vector<uint32_t> offsets,
+                                     std::vector<Neighbour> neighbours)
+    : frozen_(true),
+      offsets_(std::move(offsets)),
+      neighbours_(std::move(neighbours)) {
+}
+
+uint64_t RoadDistanceTable::MakeKey(StopId from, StopId to) noexcept {
+  return (static_cast<uint64_t>(from) << 32) | to;
+}
+
+void RoadDistanceTable::CheckNotFrozen() const {
+  if (frozen_) {
+    throw std::logic_error("Road distances are frozen");
+  }
+}
+
+uint32_t RoadDistanceTable::CheckedMeters(size_t meters) {
+  if (meters > UINT32_MAX) {
+    throw std::out_of_range("Road distance does not fit 32 bits");
+  }
+  return static_cast<uint32_t>(meters);
+}
+
+void RoadDistanceTable::Set(StopId from, StopId to, size_t meters) {
+  CheckNotFrozen();
+  pending_[MakeKey(from, to)] = CheckedMeters(meters);
+}
+
+void RoadDistanceTable::SetIfNotExist(StopId from, StopId to, size_t meters) {
+  CheckNotFrozen();
+  pending_.insert({MakeKey(from, to), CheckedMeters(meters)});
+}
+
+void RoadDistanceTable::Freeze(size_t stop_count) {
+  if (frozen_) {
+    return;
+  }
+  offsets_.assign(stop_count + 1, 0);
+  for (const auto& [key, meters] : pending_) {
+    ++offsets_[(key >> 32) + 1];
+  }
+  for (size_t stop = 0; stop < stop_count; ++stop) {
+    offsets_[stop + 1] += offsets_[stop];
+  }
+
+  neighbours_.resize(pending_.size());
+  std::vector<uint32_t> fill(offsets_.begin(), offsets_.end() - 1);
+  for (const auto& [key, meters] : pending_) {
+    neighbours_[fill[key >> 32]++] = {static_cast<StopId>(key), meters};
+  }
+  for (size_t stop = 0; stop < stop_count; ++stop) {
+    std::sort(neighbours_.begin() + offsets_[stop],
+              neighbours_.begin() + offsets_[stop + 1],
+              [](const Neighbour& lhs, const Neighbour& rhs) {
+                return lhs.stop < rhs.stop;
+              });
+  }
+
+  std::unordered_map<uint64_t, uint32_t>().swap(pending_);
+  frozen_ = true;
+}
+
+bool RoadDistanceTable::IsFrozen() const noexcept {
+  return frozen_;
+}
+
+std::optional<size_t> RoadDistanceTable::Get(StopId from, StopId to) const {
+  if (!frozen_) {
+    auto it = pending_.find(MakeKey(from, to));
+    if (it == pending_.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  if (from + 1 >= offsets_.size()) {
+    return std::nullopt;
+  }
+  const auto begin = neighbours_.begin() + offsets_[from];
+  const auto end = neighbours_.begin() + offsets_[from + 1];
+  auto it = std::lower_bound(
+      begin, end, to,
+      [](const Neighbour& neighbour, StopId stop) { return neighbour.stop < stop; });
+  if (it == end || it->stop != to) {
+    return std::nullopt;
+  }
+  return it->meters;
+}
+
+const std::vector<uint32_t>& RoadDistanceTable::GetOffsets() const noexcept {
+  return offsets_;
+}
+
+auto RoadDistanceTable::GetNeighbours() const noexcept
+    -> const std::vector<Neighbour>& {
+  return neighbours_;
+}
+
+}  // namespace bus
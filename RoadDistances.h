@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace bus {
+
+using StopId = uint32_t;
+
+// Road distances between stops for the whole network.
+// While loading it is a single hash table keyed by stop id pair,
+// Freeze turns it into CSR adjacency sorted by neighbour id
+class RoadDistanceTable {
+ public:
+  struct Neighbour {
+    StopId stop;
+    uint32_t meters;
+  };
+
+  RoadDistanceTable() = default;
+
+  // Frozen table from CSR arrays as given by GetOffsets and GetNeighbours
+  RoadDistanceTable(std::vector<uint32_t> offsets,
+                    std::vector<Neighbour> neighbours);
+
+  // Throws std::logic_error once the table is frozen and std::out_of_range
+  // for distances of 2^32 meters and more, which are stored in 32 bits
+  void Set(StopId from, StopId to, size_t meters);
+  void SetIfNotExist(StopId from, StopId to, size_t meters);
+
+  void Freeze(size_t stop_count);
+
+  [[nodiscard]] bool IsFrozen() const noexcept;
+
+  [[nodiscard]] std::optional<size_t> Get(StopId from, StopId to) const;
+
+  // Calls func(from, to, meters) for every stored distance
+  template <typename Func>
+  void ForEach(Func func) const {
+    if (!frozen_) {
+      for (const auto& [key, meters] : pending_) {
+        func(static_cast<StopId>(key >> 32), static_cast<StopId>(key), size_t{meters});
+      }
+      return;
+    }
+    for (StopId from = 0; from + 1 < offsets_.size(); ++from) {
+      for (uint32_t i = offsets_[from]; i < offsets_[from + 1]; ++i) {
+        func(from, neighbours_[i].stop, size_t{neighbours_[i].meters});
+      }
+    }
+  }
+
+  // Empty until the table is frozen
+  [[nodiscard]] const std::vector<uint32_t>& GetOffsets() const noexcept;
+  [[nodiscard]] const std::vector<Neighbour>& GetNeighbours() const noexcept;
+
+ private:
+  static uint64_t MakeKey(StopId from, StopId to) noexcept;
+  static uint32_t CheckedMeters(size_t meters);
+  void CheckNotFrozen() const;
+
+  bool frozen_{false};
+  std::unordered_map<uint64_t, uint32_t> pending_;
+
+  // Neighbours of stop s live in [offsets_[s], offsets_[s + 1])
+  std::vector<uint32_t> offsets_;
+  std::vector<Neighbour> neighbours_;
+};
+
+}  // namespace bus
@@ -0,0 +1,206 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+
+namespace bus {
+
+namespace {
+
+constexpr double kEarthRadius = 6371000;
+// HaversineDistance rounds differently from the bounds below, they are
+// loosened by this many metres to keep close points
+constexpr double kTolerance = 1;
+constexpr double kTwoPi = 2 * PI;
+
+// Smallest difference of longitudes going either way around
+double LongitudeGap(double lhs, double rhs) noexcept {
+  const double gap = std::fmod(std::abs(lhs - rhs), kTwoPi);
+  return std::min(gap, kTwoPi - gap);
+}
+
+}  // namespace
+
+//-------------------------------------------------------------------
+// Search
+
+// State of one query: the nearest stops found so far are kept in a max
+// heap, its top gives the distance a subtree has to beat once it is full
+class SpatialIndex::Search {
+ public:
+  Search(const SpatialIndex& index, const Coordinates& place, size_t count,
+         double radius)
+      : index_(index),
+        place_(place),
+        latitude_(GradToRad(place.latitude)),
+        longitude_(GradToRad(place.longitude)),
+        min_cos_latitude_(std::min(index.min_cos_latitude_, std::cos(latitude_))),
+        count_(count),
+        radius_(radius) {
+  }
+
+  void Visit(size_t first, size_t last, size_t depth, Box box) {
+    if (first >= last || LowerBound(box) - kTolerance > Limit()) {
+      return;
+    }
+    if (last - first <= kLeafSize) {
+      for (size_t i = first; i < last; ++i) {
+        Offer(index_.points_[i]);
+      }
+      return;
+    }
+
+    const size_t middle = first + (last - first) / 2;
+    const Point& split = index_.points_[middle];
+    Offer(split);
+
+    Box lower = box;
+    Box upper = box;
+    bool lower_first;
+    if (depth % 2 == 0) {
+      lower.max_latitude = upper.min_latitude = split.latitude;
+      lower_first = latitude_ < split.latitude;
+    } else {
+      lower.max_longitude = upper.min_longitude = split.longitude;
+      lower_first = longitude_ < split.longitude;
+    }
+    if (lower_first) {
+      Visit(first, middle, depth + 1, lower);
+      Visit(middle + 1, last, depth + 1, upper);
+    } else {
+      Visit(middle + 1, last, depth + 1, upper);
+      Visit(first, middle, depth + 1, lower);
+    }
+  }
+
+  std::vector<NearbyStop> TakeResult() {
+    std::sort_heap(found_.begin(), found_.end(), Closer);
+    return std::move(found_);
+  }
+
+ private:
+  static bool Closer(const NearbyStop& lhs, const NearbyStop& rhs) noexcept {
+    return lhs.distance < rhs.distance ||
+           (lhs.distance == rhs.distance && lhs.stop < rhs.stop);
+  }
+
+  [[nodiscard]] double Limit() const noexcept {
+    return found_.size() < count_ ? radius_ : found_.front().distance;
+  }
+
+  // Distance along a meridian never exceeds the distance itself, and by
+  // the haversine formula neither does 2 R cos(lat) sin(dlon / 2)
+  [[nodiscard]] double LowerBound(const Box& box) const noexcept {
+    double latitude_gap = 0;
+    if (latitude_ < box.min_latitude) {
+      latitude_gap = box.min_latitude - latitude_;
+    } else if (latitude_ > box.max_latitude) {
+      latitude_gap = latitude_ - box.max_latitude;
+    }
+    double longitude_gap = 0;
+    if (longitude_ < box.min_longitude || longitude_ > box.max_longitude) {
+      longitude_gap = std::min(LongitudeGap(longitude_, box.min_longitude),
+                               LongitudeGap(longitude_, box.max_longitude));
+    }
+    return kEarthRadius *
+           std::max(latitude_gap,
+                    2 * min_cos_latitude_ * std::sin(longitude_gap / 2));
+  }
+
+  void Offer(const Point& point) {
+    const Box box{point.latitude, point.latitude, point.longitude,
+                  point.longitude};
+    if (LowerBound(box) - kTolerance > Limit()) {
+      return;
+    }
+    const NearbyStop candidate{point.stop, HaversineDistance(place_, point.place)};
+    if (candidate.distance > radius_) {
+      return;
+    }
+    if (found_.size() < count_) {
+      found_.push_back(candidate);
+      std::push_heap(found_.begin(), found_.end(), Closer);
+    } else if (Closer(candidate, found_.front())) {
+      std::pop_heap(found_.begin(), found_.end(), Closer);
+      found_.back() = candidate;
+      std::push_heap(found_.begin(), found_.end(), Closer);
+    }
+  }
+
+  const SpatialIndex& index_;
+  const Coordinates place_;
+  const double latitude_;
+  const double longitude_;
+  const double min_cos_latitude_;
+  const size_t count_;
+  const double radius_;
+  std::vector<NearbyStop> found_;
+};
+
+//-------------------------------------------------------------------
+// SpatialIndex
+
+SpatialIndex::SpatialIndex(const std::vector<Coordinates>& places) {
+  points_.reserve(places.size());
+  for (StopId stop = 0; stop < places.size(); ++stop) {
+    points_.push_back({places[stop], GradToRad(places[stop].latitude),
+                       GradToRad(places[stop].longitude), stop});
+  }
+  if (points_.empty()) {
+    return;
+  }
+
+  bounds_ = {points_[0].latitude, points_[0].latitude, points_[0].longitude,
+             points_[0].longitude};
+  for (const Point& point : points_) {
+    bounds_.min_latitude = std::min(bounds_.min_latitude, point.latitude);
+    bounds_.max_latitude = std::max(bounds_.max_latitude, point.latitude);
+    bounds_.min_longitude = std::min(bounds_.min_longitude, point.longitude);
+    bounds_.max_longitude = std::max(bounds_.max_longitude, point.longitude);
+  }
+  min_cos_latitude_ = std::min(std::cos(bounds_.min_latitude),
+                               std::cos(bounds_.max_latitude));
+  Build(0, points_.size(), 0);
+}
+
+SpatialIndex::SpatialIndex(Tables tables)
+    : points_(std::move(tables.points)),
+      bounds_(tables.bounds),
+      min_cos_latitude_(tables.min_cos_latitude) {
+}
+
+auto SpatialIndex::GetTables() const -> Tables {
+  return {points_, bounds_, min_cos_latitude_};
+}
+
+void SpatialIndex::Build(size_t first, size_t last, size_t depth) {
+  if (last - first <= kLeafSize) {
+    return;
+  }
+  const size_t middle = first + (last - first) / 2;
+  const bool by_latitude = depth % 2 == 0;
+  std::nth_element(points_.begin() + first, points_.begin() + middle,
+                   points_.begin() + last,
+                   [by_latitude](const Point& lhs, const Point& rhs) {
+                     return by_latitude ? lhs.latitude < rhs.latitude
+                                        : lhs.longitude < rhs.longitude;
+                   });
+  Build(first, middle, depth + 1);
+  Build(middle + 1, last, depth + 1);
+}
+
+size_t SpatialIndex::Size() const noexcept {
+  return points_.size();
+}
+
+std::vector<NearbyStop> SpatialIndex::FindNearest(const Coordinates& place,
+                                                  size_t count,
+                                                  double radius) const {
+  if (count == 0 || radius < 0 || points_.empty()) {
+    return {};
+  }
+  Search search(*this, place, count, radius);
+  search.Visit(0, points_.size(), 0, bounds_);
+  return search.TakeResult();
+}
+
+}  // namespace bus
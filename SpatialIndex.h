@@ -0,0 +1,74 @@
+#pragma once
+#include "BusManager.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace bus {
+
+struct NearbyStop {
+  StopId stop;
+  double distance;  // metres, as given by HaversineDistance
+};
+
+// Static k-d tree over stop positions in radians, split alternately by
+// latitude and longitude at the median, laid out implicitly in one array.
+// Subtrees and single stops are rejected by their equirectangular box:
+// latitude difference and longitude difference scaled by the smallest
+// cosine of latitude are both lower bounds of the distance on a sphere,
+// so only stops inside the box get the exact HaversineDistance
+class SpatialIndex {
+ public:
+  // Stop in tree order, plain records without padding
+  struct Point {
+    Coordinates place;
+    double latitude;   // radians
+    double longitude;  // radians
+    StopId stop;
+    uint32_t reserved{0};
+  };
+
+  struct Box {
+    double min_latitude;
+    double max_latitude;
+    double min_longitude;
+    double max_longitude;
+  };
+
+  // Everything an index is made of, e.g. to save it into a snapshot
+  struct Tables {
+    std::vector<Point> points;
+    Box bounds{};
+    double min_cos_latitude{1};
+  };
+
+  SpatialIndex() = default;
+  explicit SpatialIndex(const std::vector<Coordinates>& places);
+  // Tree built before, points are taken in the order given
+  explicit SpatialIndex(Tables tables);
+
+  [[nodiscard]] Tables GetTables() const;
+
+  [[nodiscard]] size_t Size() const noexcept;
+
+  // Up to count stops not farther than radius metres, nearest first,
+  // equal distances in order of stop id
+  [[nodiscard]] std::vector<NearbyStop> FindNearest(const Coordinates& place,
+                                                    size_t count,
+                                                    double radius) const;
+
+ private:
+  // Ranges this small are scanned without splitting
+  static constexpr size_t kLeafSize = 8;
+
+  class Search;
+
+  void Build(size_t first, size_t last, size_t depth);
+
+  std::vector<Point> points_;
+  Box bounds_{};
+  // Cosine of the largest absolute latitude among stops
+  double min_cos_latitude_{1};
+};
+
+}  // namespace bus
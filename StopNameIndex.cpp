@@ -0,0 +1,159 @@
+#include "StopNameIndex.h"
+#include <algorithm>
+
+namespace bus {
+
+StopNameIndex::StopNameIndex(const NamePool& names,
+                             const std::vector<NameId>& stop_names) {
+  entries_.reserve(stop_names.size());
+  for (StopId stop = 0; stop < stop_names.size(); ++stop) {
+    entries_.push_back({names.Get(stop_names[stop]), stop, 0});
+  }
+  std::sort(entries_.begin(), entries_.end(), [](const Entry& lhs, const Entry& rhs) {
+    return std::pair{lhs.name, lhs.stop} < std::pair{rhs.name, rhs.stop};
+  });
+
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    max_name_length_ = std::max(max_name_length_, entries_[i].name.size());
+    if (i == 0) {
+      continue;
+    }
+    const auto& previous = entries_[i - 1].name;
+    const auto& name = entries_[i].name;
+    const auto mismatch = std::mismatch(previous.begin(), previous.end(),
+                                        name.begin(), name.end());
+    entries_[i].common_prefix =
+        static_cast<uint32_t>(mismatch.first - previous.begin());
+  }
+}
+
+StopNameIndex::StopNameIndex(const NamePool& names,
+                             const std::vector<NameId>& stop_names,
+                             const std::vector<Record>& records) {
+  entries_.reserve(records.size());
+  for (const Record& record : records) {
+    entries_.push_back({names.Get(stop_names.at(record.stop)), record.stop,
+                        record.common_prefix});
+    max_name_length_ = std::max(max_name_length_, entries_.back().name.size());
+  }
+}
+
+std::vector<StopNameIndex::Record> StopNameIndex::GetRecords() const {
+  std::vector<Record> records;
+  records.reserve(entries_.size());
+  for (const Entry& entry : entries_) {
+    records.push_back({entry.stop, entry.common_prefix});
+  }
+  return records;
+}
+
+size_t StopNameIndex::Size() const noexcept {
+  return entries_.size();
+}
+
+std::vector<StopMatch> StopNameIndex::FindByPrefix(std::string_view prefix,
+                                                   size_t count) const {
+  auto it = std::lower_bound(
+      entries_.begin(), entries_.end(), prefix,
+      [](const Entry& entry, std::string_view value) { return entry.name < value; });
+
+  std::vector<StopMatch> result;
+  for (; it != entries_.end() && result.size() < count && it->name.starts_with(prefix);
+       ++it) {
+    result.push_back({it->stop, 0});
+  }
+  return result;
+}
+
+std::vector<StopMatch> StopNameIndex::FindFuzzy(std::string_view query,
+                                                size_t count,
+                                                uint32_t max_edits) const {
+  // Enough exact prefixes leave nothing for edits to add
+  if (auto exact = FindByPrefix(query, count); max_edits == 0 || exact.size() == count) {
+    return exact;
+  }
+
+  // Row d holds edits between the first d bytes of the current name and
+  // every prefix of the query, rows of the prefix shared with the previous
+  // name stay valid. best[d] is the fewest edits for the whole query over
+  // name prefixes not longer than d
+  const size_t width = query.size() + 1;
+  std::vector<uint32_t> rows((max_name_length_ + 1) * width);
+  std::vector<uint32_t> best(max_name_length_ + 1);
+  for (size_t j = 0; j < width; ++j) {
+    rows[j] = static_cast<uint32_t>(j);
+  }
+  best[0] = static_cast<uint32_t>(query.size());
+
+  // Max heap of (edits, entry) pairs: the worst match kept is on top
+  std::vector<std::pair<uint32_t, size_t>> found;
+  auto offer = [&found, count](uint32_t edits, size_t entry) {
+    if (found.size() < count) {
+      found.emplace_back(edits, entry);
+      std::push_heap(found.begin(), found.end());
+    } else if (std::pair{edits, entry} < found.front()) {
+      std::pop_heap(found.begin(), found.end());
+      found.back() = {edits, entry};
+      std::push_heap(found.begin(), found.end());
+    }
+  };
+
+  size_t valid_rows = 0;
+  for (size_t i = 0; i < entries_.size();) {
+    // Names come in order, so a full heap is only beaten with fewer edits
+    if (found.size() == count && found.front().first == 0) {
+      break;
+    }
+    const uint32_t limit = found.size() < count ? max_edits : found.front().first - 1;
+
+    const std::string_view name = entries_[i].name;
+    size_t depth = std::min<size_t>(valid_rows, entries_[i].common_prefix);
+    bool pruned = false;
+    while (depth < name.size()) {
+      const uint32_t* previous = rows.data() + depth * width;
+      uint32_t* current = rows.data() + (depth + 1) * width;
+      current[0] = static_cast<uint32_t>(depth + 1);
+      uint32_t row_min = current[0];
+      for (size_t j = 1; j < width; ++j) {
+        current[j] = std::min({previous[j] + 1, current[j - 1] + 1,
+                               previous[j - 1] + (name[depth] != query[j - 1])});
+        row_min = std::min(row_min, current[j]);
+      }
+      ++depth;
+      best[depth] = std::min(best[depth - 1], current[width - 1]);
+      // Rows never get smaller minimums, longer prefixes are hopeless
+      if (row_min > limit) {
+        pruned = true;
+        break;
+      }
+    }
+    valid_rows = depth;
+
+    // Names sharing the hopeless prefix cost exactly the same
+    size_t last = i + 1;
+    if (pruned) {
+      const std::string_view prefix = name.substr(0, depth);
+      last = std::partition_point(entries_.begin() + last, entries_.end(),
+                                  [prefix](const Entry& entry) {
+                                    return entry.name.starts_with(prefix);
+                                  }) -
+             entries_.begin();
+    }
+    if (const uint32_t edits = best[depth]; edits <= limit) {
+      for (size_t entry = i; entry < std::min(last, i + count); ++entry) {
+        offer(edits, entry);
+      }
+    }
+    i = last;
+  }
+
+  std::sort_heap(found.begin(), found.end());
+  std::vector<StopMatch> result;
+  result.reserve(found.size());
+  for (const auto& [edits, entry] : found) {
+    result.push_back({entries_[entry].stop, edits});
+  }
+  return result;
+}
+
+}  // namespace bus
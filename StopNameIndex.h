@@ -0,0 +1,62 @@
+#pragma once
+#include "NamePool.h"
+#include "RoadDistances.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace bus {
+
+struct StopMatch {
+  StopId stop;
+  uint32_t edits;  // 0 for prefix matches
+};
+
+// Stop names sorted in one array with the length of the prefix every name
+// shares with the previous one. Names starting with the same text form a
+// range, so the array serves as a trie without nodes: prefix search is a
+// binary search, fuzzy search walks names in order and reuses edit
+// distance rows of the common prefix. Names are views to the pool
+class StopNameIndex {
+ public:
+  // Entry without its name, e.g. to save the index into a snapshot
+  struct Record {
+    StopId stop;
+    uint32_t common_prefix;  // with the previous entry
+  };
+
+  StopNameIndex() = default;
+  // stop_names are indexed by StopId
+  StopNameIndex(const NamePool& names, const std::vector<NameId>& stop_names);
+  // Index sorted before, records are taken in the order given
+  StopNameIndex(const NamePool& names, const std::vector<NameId>& stop_names,
+                const std::vector<Record>& records);
+
+  [[nodiscard]] std::vector<Record> GetRecords() const;
+
+  [[nodiscard]] size_t Size() const noexcept;
+
+  // Up to count stops whose names start with prefix, in order of names
+  [[nodiscard]] std::vector<StopMatch> FindByPrefix(std::string_view prefix,
+                                                    size_t count) const;
+
+  // Up to count stops with a name prefix at most max_edits away from the
+  // query (Levenshtein distance over bytes), fewer edits first, then in
+  // order of names. With max_edits == 0 it is the prefix search
+  [[nodiscard]] std::vector<StopMatch> FindFuzzy(std::string_view query,
+                                                 size_t count,
+                                                 uint32_t max_edits) const;
+
+ private:
+  struct Entry {
+    std::string_view name;
+    StopId stop;
+    uint32_t common_prefix;  // with the previous entry
+  };
+
+  std::vector<Entry> entries_;
+  size_t max_name_length_{0};
+};
+
+}  // namespace bus
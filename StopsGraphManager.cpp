@@ -1,38 +1,58 @@
 #include "StopsGraphManager.h"
+#include "FrozenNetwork.h"
+#include "utility/parallel.h"
 
 namespace bus {
  
-void BusManagerWithRouter::AddAllEdges() {
-  using namespace Graph;
-  auto& graph = graph_.value();
-
-  for (const auto& [name, record_ptr] : bus_index_) {
-    const BusRecord& bus_record = *(record_ptr.get());
-    const auto& stops = bus_record.GetStops();
-
-    for (auto it = stops.begin(); it != stops.end(); ++it) {
-      const StopRecord& current_stop = *(it->lock().get());
-      VertexId stop_wait_num =
-          GetIndexFromStop(current_stop.GetName(), NodeType::WAIT).value();
-      VertexId route_stop_num =
-          GetIndexFromStop(current_stop.GetName(), NodeType::BUS).value();
-
-      // first adding edges representing getting on the bus from the
-      // stop
-      graph.AddEdge({stop_wait_num, route_stop_num, WeightWithSpan{wait_time_}});
+void BusManagerWithRouter::AddAllEdges(GraphType& graph) const {
+  const auto buses = GetBusRecords();
+
+  // Every worker takes a contiguous chunk of buses and fills its own buffer
+  auto buffers = utility::ParallelChunks(
+      buses.size(), [this, &buses](size_t first, size_t last) {
+        EdgeBuffer buffer;
+        for (size_t i = first; i < last; ++i) {
+          AddBusEdges(*buses[i], buffer);
+        }
+        return buffer;
+      },
+      thread_count_);
+
+  // Chunks are merged in order, so edge ids are the same as for a serial pass
+  for (const auto& buffer : buffers) {
+    for (const auto& edge : buffer) {
+      graph.AddEdge(edge);
     }
+  }
+}
 
+void BusManagerWithRouter::AddBusEdges(const BusRecord& bus_record,
+                                       EdgeBuffer& buffer) const {
+  using namespace Graph;
+  const auto& stops = bus_record.GetStops();
 
-    AddEdgesHelper(stops.begin(), stops.end(), bus_record.GetName());
-    if (bus_record.GetType() == BusRecord::RouteType::Linear) {
-      AddEdgesHelper(stops.rbegin(), stops.rend(), bus_record.GetName());
-    }
+  for (auto it = stops.begin(); it != stops.end(); ++it) {
+    const StopId stop_id = *it;
+    VertexId stop_wait_num = ToVertexId(stop_id, NodeType::WAIT);
+    VertexId route_stop_num = ToVertexId(stop_id, NodeType::BUS);
 
+    // first adding edges representing getting on the bus from the
+    // stop
+    buffer.push_back({stop_wait_num, route_stop_num, WeightWithSpan{wait_time_}});
+  }
+
+  // Edges keep the name id, so they do not depend on where names are
+  const NameId route = *names_.Find(bus_record.GetName());
+  AddEdgesHelper(stops.begin(), stops.end(), route, buffer);
+  if (bus_record.GetType() == BusRecord::RouteType::Linear) {
+    AddEdgesHelper(stops.rbegin(), stops.rend(), route, buffer);
   }
 }
 
 template <typename Iter, typename>
-void BusManagerWithRouter::AddEdgesHelper(Iter begin, Iter end, std::string_view route) {
+void BusManagerWithRouter::AddEdgesHelper(Iter begin, Iter end,
+                                          NameId route,
+                                          EdgeBuffer& buffer) const {
   using namespace Graph;
   size_t count = std::distance(begin, end);
   if (count < 2) {
@@ -43,22 +63,18 @@ void BusManagerWithRouter::AddEdgesHelper(Iter begin, Iter end, std::string_view
   double rolling_sum = 0.0;
 
   for (size_t i = 1; i < count; ++i) {
-    double step_dist = RouteDistance(*(begin + i - 1), *(begin + i));
+    double step_dist = RouteDistance(stops_, distances_, *(begin + i - 1), *(begin + i));
     partial_sums[i] = (rolling_sum += step_dist);
   }
 
+  buffer.reserve(buffer.size() + count * (count - 1) / 2);
   for (size_t i = 0; i < count; ++i) {
     for (size_t j = i + 1; j < count; ++j) {
-      const StopRecord& current_stop = *((begin + i)->lock().get()); //kek
-      const StopRecord& end_stop = *((begin + j)->lock().get());
+      VertexId current_stop_num = ToVertexId(*(begin + i), NodeType::BUS);
+      VertexId end_stop_num = ToVertexId(*(begin + j), NodeType::WAIT);
+      const auto span_count = static_cast<uint32_t>(j - i);
 
-      VertexId current_stop_num =
-          GetIndexFromStop(current_stop.GetName(), NodeType::BUS).value();
-      VertexId end_stop_num =
-          GetIndexFromStop(end_stop.GetName(), NodeType::WAIT).value();
-      size_t span_count = j - i;
-
-      graph_->AddEdge(
+      buffer.push_back(
           {current_stop_num, end_stop_num,
            WeightWithSpan{(partial_sums[j] - partial_sums[i]) / velocity_,
                           span_count, route}});
@@ -66,96 +82,40 @@ void BusManagerWithRouter::AddEdgesHelper(Iter begin, Iter end, std::string_view
   }
 }
 
-void BusManagerWithRouter::InitializeGraph() {
-  size_t current_node = 0;
-
-  for (const auto& [name, record_ptr] : stop_index_) {
-    const StopRecord& stop_record = *(record_ptr.get());
-    // First add wait node
-    index_.insert({{name, NodeType::WAIT}, current_node});
-    reverse_index_.insert({current_node++, {name, NodeType::WAIT}});
-    // Then add node for routes going through stop
-
-    index_.insert({{name, NodeType::BUS}, current_node});
-    reverse_index_.insert({{current_node++, {name, NodeType::BUS}}});
-
-  }
-
-  if (current_node == 0) {
-    return; // No stops - we are done
+std::optional<BusManagerWithRouter::GraphType> BusManagerWithRouter::BuildGraph()
+    const {
+  const size_t vertex_count = 2 * GetStopCount();
+  if (vertex_count == 0) {
+    return std::nullopt; // No stops - we are done
   }
 
-  graph_ = GraphType(current_node);
+  GraphType graph(vertex_count);
 
   // Now iterate along the routes and add edges
-  AddAllEdges();
+  AddAllEdges(graph);
+  return graph;
 }
 
-std::optional<Graph::VertexId> BusManagerWithRouter::GetIndexFromStop(
-    std::string_view name, NodeType route) const {
-  auto iter = index_.find({name, route});
-  if (iter == index_.end()) {
-    return {};
+std::shared_ptr<const FrozenNetwork> BusManagerWithRouter::Freeze() {
+  FinishLoading();
+
+  // RAPTOR is linear in size of the network, so it is always available
+  // for requests which need it, e.g. minimal amount of transfers
+  RaptorRouter raptor(GetBusRecords(), stops_, distances_, velocity_, wait_time_);
+  std::optional<GraphType> graph;
+  std::optional<ConnectionScanRouter> timetable;
+  if (algorithm_ == RoutingAlgorithm::GRAPH) {
+    graph = BuildGraph();
+  } else if (algorithm_ == RoutingAlgorithm::TIMETABLE) {
+    timetable.emplace(*this);
   }
-  return iter->second;
-}
 
-std::optional<std::pair<std::string_view, NodeType>> BusManagerWithRouter::GetStopFromIndex(size_t num) const {
-  auto iter = reverse_index_.find(num);
-  if (iter == reverse_index_.end()) {
-    return {};
-  }
-  return iter->second;
+  NetworkTables tables = TakeTables();
+  tables.algorithm = algorithm_;
+  tables.graph = std::move(graph);
+  tables.raptor.emplace(std::move(raptor));
+  tables.timetable = std::move(timetable);
+  return std::make_shared<const FrozenNetwork>(std::move(tables));
 }
 
-void BusManagerWithRouter::InitializeRouter() {
-  InitializeGraph();
-  router_.emplace(Router(GetRouteGraph()));
-}
-
-const BusManagerWithRouter::GraphType& BusManagerWithRouter::GetRouteGraph()
-    const {
-  if (!graph_.has_value()) {
-    throw std::runtime_error("Route graph has not been created");
-  }
-  return graph_.value();
-}
-
-std::optional<BusManagerWithRouter::Router::RouteInfo>
-BusManagerWithRouter::BuildNewRoute(std::string_view from,
-                                    std::string_view to) const {
-  using namespace Graph;
-  auto start_it = index_.find({from, NodeType::WAIT});
-  auto end_it = index_.find({to, NodeType::WAIT});
-
-  VertexId node_from = start_it->second;
-  VertexId node_to = end_it->second;
-
-  // prepare views to strings saved in database
-  // we can get them from index here without looking for records specifically
-  from = start_it->first.first;
-  to = end_it->first.first;
-
-  auto info = router_->BuildRoute(node_from, node_to);
-  route_cache_.insert({{from, to}, info});
-  return info;
-}
-
-std::optional<BusManagerWithRouter::Router::RouteInfo>
-BusManagerWithRouter::GetRoute(std::string_view from, std::string_view to) const {
-  auto it = route_cache_.find({from, to});
-  if (it != route_cache_.end()) {
-    return it->second;
-  } else {
-    return BuildNewRoute(from, to);
-  }
-}
-
- const BusManagerWithRouter::Router& BusManagerWithRouter::GetRouter() const {
-  if (!router_.has_value()) {
-    throw std::runtime_error("Router has not been initialized");
-  }
-  return router_.value();
- }
-
 }  // namespace bus
\ No newline at end of file
@@ -2,7 +2,10 @@
 #include "BusManager.h"
 #include "graph.h"
 #include "router.h"
+#include "Raptor.h"
+#include "Csa.h"
 #include <stdexcept>
+#include <thread>
 
 
 
@@ -15,65 +18,70 @@ enum class NodeType {
   BUS, WAIT
 };
 
+// GRAPH precomputes all routes on a stop graph, RAPTOR scans bus stop
+// sequences per request and needs no quadratic preprocessing,
+// TIMETABLE uses trips instead of constant wait time
+enum class RoutingAlgorithm { GRAPH, RAPTOR, TIMETABLE };
+
+const std::unordered_map<std::string_view, RoutingAlgorithm>
+    STR_TO_ROUTING_ALGORITHM = {{"graph", RoutingAlgorithm::GRAPH},
+                                {"raptor", RoutingAlgorithm::RAPTOR},
+                                {"timetable", RoutingAlgorithm::TIMETABLE}};
+
+// Every stop owns two vertices: 2 * stop_id for riding a bus through it
+// and 2 * stop_id + 1 for waiting at it
+inline Graph::VertexId ToVertexId(size_t stop_id, NodeType type) noexcept {
+  return 2 * stop_id + static_cast<Graph::VertexId>(type);
+}
+
 class BusManagerWithRouter : public bus::BusManager {
  public:
   using WeightWithSpan = utility::WeightWithSpan;
   using GraphType = Graph::DirectedWeightedGraph<WeightWithSpan>;
   using Router = Graph::Router<WeightWithSpan>;
-  using IndexHash = utility::pair_hash<std::string_view, NodeType>;
-  using CacheHash = utility::pair_hash<std::string_view, std::string_view>;
-  using StopIndex =
-      std::unordered_map<std::pair<std::string_view, NodeType>,
-                         Graph::VertexId,
-      IndexHash>;
-  using ReverseStopIndex = std::unordered_map<
-      Graph::VertexId, std::pair<std::string_view, NodeType>>;
-  // Using simple cache without eviction here as an example
-  using RouteCache = std::unordered_map<std::pair<std::string_view, std::string_view>, std::optional<Router::RouteInfo>, CacheHash>;
-
-  BusManagerWithRouter(double velocity, double wait_time)
-      : velocity_(velocity * 1000 / 60), wait_time_(wait_time){}; // velocity in metre per minute
-
-  void InitializeRouter();
-  
-  [[nodiscard]] const GraphType& GetRouteGraph() const;
-  [[nodiscard]] const Router& GetRouter() const;
-  [[nodiscard]] std::optional<size_t> GetIndexFromStop(
-      std::string_view name, NodeType type) const;
-  [[nodiscard]] std::optional<std::pair<std::string_view, NodeType>>
-  GetStopFromIndex(size_t num) const;
-
-  // Checks for route in cache and invokes BuildNewRoute if cannot find
-  [[nodiscard]] std::optional<Router::RouteInfo> GetRoute(
-      std::string_view from, std::string_view to) const;
 
+  BusManagerWithRouter(double velocity, double wait_time,
+                       RoutingAlgorithm algorithm = RoutingAlgorithm::GRAPH)
+      : velocity_(velocity * 1000 / 60), wait_time_(wait_time), algorithm_(algorithm){}; // velocity in metre per minute
+
+  // Settings are only used by Freeze, so they may come after the network
+  void SetRoutingSettings(double velocity, double wait_time,
+                          RoutingAlgorithm algorithm) {
+    velocity_ = velocity * 1000 / 60;
+    wait_time_ = wait_time;
+    algorithm_ = algorithm;
+  }
+
+  // Workers generating graph edges, the graph is the same for any number
+  void SetThreadCount(size_t thread_count) {
+    thread_count_ = thread_count;
+  }
+
+  // Builds routers for the algorithm on top of the frozen network data
+  std::shared_ptr<const FrozenNetwork> Freeze() override;
 
 
  private:
   // static void AddAllEdges(BusManagerWithRouter& manager);
   // another variant
-  using StopsIter = std::vector<bus::StopRecordWeakPtr>::const_iterator;
-  void AddAllEdges();
+  using EdgeBuffer = std::vector<Graph::Edge<WeightWithSpan>>;
+
+  // Generates edges for buses in parallel and merges them into the graph in
+  // bus order, so edge ids do not depend on the number of threads
+  void AddAllEdges(GraphType& graph) const;
+  void AddBusEdges(const BusRecord& bus_record, EdgeBuffer& buffer) const;
   template <typename Iter, typename = std::enable_if_t<std::is_same_v<
                                std::remove_const_t<typename Iter::value_type>,
-                               bus::StopRecordWeakPtr>>>
-  void AddEdgesHelper(Iter begin, Iter end, std::string_view route);
-
-  void InitializeGraph();
+                               bus::StopId>>>
+  void AddEdgesHelper(Iter begin, Iter end, NameId route,
+                      EdgeBuffer& buffer) const;
 
-  // Uses Router to get route information and saves it in cache
-  [[nodiscard]] std::optional<Router::RouteInfo> BuildNewRoute(std::string_view from, std::string_view to) const;
+  [[nodiscard]] std::optional<GraphType> BuildGraph() const;
 
   double velocity_;
   double wait_time_;
-  std::optional<GraphType> graph_{std::nullopt};
-  std::optional<Router> router_{std::nullopt};
-
-  // Every stop is represented by the amount of nodes equaling to nummer of routes going through it + 1
-  // (every stop has a separate node representing standing at the stop waiting for a bus)
-  StopIndex index_;
-  ReverseStopIndex reverse_index_;
-  mutable RouteCache route_cache_;
+  RoutingAlgorithm algorithm_;
+  size_t thread_count_ = std::thread::hardware_concurrency();
 };
 
 }  // namespace bus
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <cstdlib>
 #include <deque>
+#include <utility>
 #include <vector>
 
 template <typename It>
@@ -37,12 +38,18 @@ struct Edge {
 
 template <typename Weight>
 class DirectedWeightedGraph {
- private:
+ public:
   using IncidenceList = std::vector<EdgeId>;
+
+ private:
   using IncidentEdgesRange = Range<typename IncidenceList::const_iterator>;
 
  public:
   DirectedWeightedGraph(size_t vertex_count);
+  // Takes edges and incidence lists as GetEdge and GetIncidentEdges give
+  // them, one list per vertex
+  DirectedWeightedGraph(std::vector<Edge<Weight>> edges,
+                        std::vector<IncidenceList> incidence_lists);
   EdgeId AddEdge(const Edge<Weight>& edge);
 
   size_t GetVertexCount() const;
@@ -60,6 +67,12 @@ DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
     : incidence_lists_(vertex_count) {
 }
 
+template <typename Weight>
+DirectedWeightedGraph<Weight>::DirectedWeightedGraph(
+    std::vector<Edge<Weight>> edges, std::vector<IncidenceList> incidence_lists)
+    : edges_(std::move(edges)), incidence_lists_(std::move(incidence_lists)) {
+}
+
 template <typename Weight>
 EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
   edges_.push_back(edge);
@@ -1,15 +1,25 @@
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <random>
 #include <iomanip>
+#include <cstring>
 
 
 #include "utility/test_runner.h"
 #include "utility/profile.h"
 #include "BusManager.h"
+#include "Haversine.h"
 #include "Parcing/Parcing.h"
 #include "Command.h"
+#include "NetworkPublisher.h"
+#include "NetworkSnapshot.h"
 #include "Json/json.h"
+#include "Json/structural.h"
+#include "utility/mapped_file.h"
+#include "utility/parallel.h"
 #include <algorithm>
+#include <thread>
 
 //----------------------------------------------------------------------------------------
 // Forward declarations
@@ -22,6 +32,19 @@ std::vector<Request::RequestHolder> ParseRequests(
 void ProcessModifyRequests(const std::vector<Request::RequestHolder>& requests,
                            bus::BusManager& manager);
 
+std::vector<Request::RequestHolder> ParseRequests(const Dictionary& index,
+                                                  const Json::Value& node);
+
+void LoadBaseRequests(Json::Reader& reader, bus::BusManager& manager);
+
+std::vector<Request::RequestHolder> ParseRequestsParallel(
+    const Dictionary& index, std::span<const std::string_view> elements,
+    size_t thread_count = std::thread::hardware_concurrency());
+
+void ProcessReadRequestsToJson(const std::vector<Request::RequestHolder>& requests,
+                               const bus::FrozenNetwork& network,
+                               Json::Writer& writer);
+
 //----------------------------------------------------------------------------------------
 
 void TrimRightLeft() {
@@ -115,18 +138,829 @@ void AddGetBus() {
   const BusRecord& bus1 = manager.GetBus("101").value();
 
 
-  auto stop1_ptr = bus1.GetStops()[0].lock();
-  auto stop3_ptr = bus1.GetStops()[1].lock();
-  ASSERT_EQUAL(stop1_ptr->GetName(), "stop1");
+  const StopRecord& stop1 = manager.GetStopById(bus1.GetStops()[0]);
+  const StopRecord& stop3 = manager.GetStopById(bus1.GetStops()[1]);
+  ASSERT_EQUAL(stop1.GetName(), "stop1");
 
-  const auto& pos1 = stop1_ptr->GetCoordinates();
-  const auto& pos3 = stop3_ptr->GetCoordinates();
+  const auto& pos1 = stop1.GetCoordinates();
+  const auto& pos3 = stop3.GetCoordinates();
   ASSERT_EQUAL(pos1.latitude, 1.0);
   ASSERT_EQUAL(pos1.longitude, 1.0);
   ASSERT_EQUAL(pos3.latitude, -1.0);
   ASSERT_EQUAL(pos3.longitude, 1.0);
 }
 
+void StopIdsAreDense() {
+  using namespace bus;
+
+  BusManagerWithRouter manager(40, 6);
+  manager.AddStop("stop1", {1.0, 1.0}, {{"stop3", 100}});
+  manager.AddBus("101", {"stop1", "stop2", "stop3"}, BusRecord::RouteType::Linear);
+  ASSERT_EQUAL(manager.GetStopById(1).GetId(), 1u);
+  auto network = manager.Freeze();
+
+  ASSERT_EQUAL(network->GetStopCount(), 3u);
+  for (StopId id = 0; id < network->GetStopCount(); ++id) {
+    const auto name = network->GetStopName(id);
+    ASSERT_EQUAL(network->FindStop(name).value(), id);
+    ASSERT_EQUAL(network->GetIndexFromStop(name, NodeType::WAIT).value(), 2 * id + 1);
+    ASSERT_EQUAL(network->GetStopFromIndex(2 * id).value().first, name);
+  }
+  ASSERT(!network->GetStopFromIndex(6).has_value());
+}
+
+void RaptorMatchesGraph() {
+  using namespace bus;
+
+  auto fill = [](BusManagerWithRouter& manager) {
+    manager.AddStop("A", {55.60, 37.20}, {{"B", 2000}, {"D", 12000}});
+    manager.AddStop("B", {55.61, 37.21}, {{"C", 3000}});
+    manager.AddStop("C", {55.62, 37.22}, {{"D", 1000}});
+    manager.AddStop("D", {55.63, 37.23});
+    manager.AddStop("E", {55.64, 37.24});
+    manager.AddBus("1", {"A", "B", "C"}, BusRecord::RouteType::Linear);
+    manager.AddBus("2", {"C", "D"}, BusRecord::RouteType::Linear);
+    manager.AddBus("3", {"A", "D", "A"}, BusRecord::RouteType::Circular);
+    return manager.Freeze();
+  };
+  BusManagerWithRouter graph_manager(30, 6);
+  BusManagerWithRouter raptor_manager(30, 6, RoutingAlgorithm::RAPTOR);
+  auto graph = fill(graph_manager);
+  auto raptor = fill(raptor_manager);
+
+  for (std::string_view from : {"A", "B", "C", "D", "E"}) {
+    for (std::string_view to : {"A", "B", "C", "D", "E"}) {
+      auto expected = graph->GetRoute(from, to);
+      auto journey = raptor->GetRaptorRoute(from, to);
+      ASSERT_EQUAL(expected.has_value(), journey.has_value());
+      if (expected) {
+        ASSERT(std::abs(expected->weight.time - journey->total_time) < 1e-9);
+      }
+    }
+  }
+
+  // A -> D by two buses is faster, but there is a direct one
+  auto fastest = raptor->GetRaptorRoute("A", "D");
+  auto direct = raptor->GetRaptorRoute("A", "D", RaptorRouter::Criterion::MIN_TRANSFERS);
+  ASSERT_EQUAL(fastest->legs.size(), 2u);
+  ASSERT_EQUAL(direct->legs.size(), 1u);
+  ASSERT_EQUAL(direct->legs[0].bus, "3");
+  ASSERT(direct->total_time > fastest->total_time);
+}
+
+void GraphEdgesIndependentOfThreads() {
+  using namespace bus;
+
+  auto build = [](size_t thread_count) {
+    BusManagerWithRouter manager(30, 6);
+    manager.SetThreadCount(thread_count);
+    manager.AddStop("A", {55.60, 37.20}, {{"B", 2000}, {"D", 12000}});
+    manager.AddStop("B", {55.61, 37.21}, {{"C", 3000}});
+    manager.AddStop("C", {55.62, 37.22}, {{"D", 1000}});
+    manager.AddStop("D", {55.63, 37.23}, {{"E", 500}});
+    manager.AddStop("E", {55.64, 37.24});
+    manager.AddBus("1", {"A", "B", "C"}, BusRecord::RouteType::Linear);
+    manager.AddBus("2", {"C", "D"}, BusRecord::RouteType::Linear);
+    manager.AddBus("3", {"A", "D", "A"}, BusRecord::RouteType::Circular);
+    manager.AddBus("4", {"E", "D", "C", "B"}, BusRecord::RouteType::Linear);
+    manager.AddBus("5", {"B", "E", "B"}, BusRecord::RouteType::Circular);
+    manager.AddBus("6", {"A", "E"}, BusRecord::RouteType::Linear);
+    manager.AddBus("7", {"D", "B", "A", "D"}, BusRecord::RouteType::Circular);
+    return manager.Freeze();
+  };
+  const auto serial = build(1);
+  const auto& expected = serial->GetRouteGraph();
+
+  for (size_t thread_count : {2, 3, 8}) {
+    const auto network = build(thread_count);
+    const auto& graph = network->GetRouteGraph();
+    ASSERT_EQUAL(graph.GetEdgeCount(), expected.GetEdgeCount());
+    for (Graph::EdgeId id = 0; id < graph.GetEdgeCount(); ++id) {
+      const auto& edge = graph.GetEdge(id);
+      const auto& other = expected.GetEdge(id);
+      ASSERT_EQUAL(edge.from, other.from);
+      ASSERT_EQUAL(edge.to, other.to);
+      ASSERT_EQUAL(edge.weight.time, other.weight.time);
+      ASSERT_EQUAL(edge.weight.span, other.weight.span);
+      ASSERT_EQUAL(edge.weight.route, other.weight.route);
+    }
+
+    for (std::string_view from : {"A", "B", "C", "D", "E"}) {
+      for (std::string_view to : {"A", "B", "C", "D", "E"}) {
+        const auto route = network->GetRoute(from, to);
+        const auto other = serial->GetRoute(from, to);
+        ASSERT_EQUAL(route.has_value(), other.has_value());
+        if (route) {
+          ASSERT_EQUAL(route->weight.time, other->weight.time);
+          ASSERT_EQUAL(route->edges, other->edges);
+        }
+      }
+    }
+  }
+}
+
+void TimetableEarliestArrival() {
+  using namespace bus;
+
+  BusManagerWithRouter manager(30, 6, RoutingAlgorithm::TIMETABLE);
+  manager.AddStop("A", {55.60, 37.20});
+  manager.AddStop("B", {55.61, 37.21});
+  manager.AddStop("C", {55.62, 37.22});
+  manager.AddBus("1", {"A", "B"}, BusRecord::RouteType::Linear);
+  manager.AddBus("2", {"B", "C"}, BusRecord::RouteType::Linear);
+  manager.AddTrip("1", {10, 20, 30});
+  manager.AddTrip("1", {40, 50, 60});
+  manager.AddTrip("2", {15, 25, 35});
+  manager.AddTrip("2", {22, 30, 38});
+  auto network = manager.Freeze();
+
+  ASSERT_EQUAL(network->GetTimetableRouter().GetConnections().size(), 8u);
+
+  auto journey = network->GetTimetableRoute("A", "C", 5);
+  ASSERT(journey.has_value());
+  ASSERT_EQUAL(journey->total_time, 25.0);
+  ASSERT_EQUAL(journey->legs.size(), 2u);
+  ASSERT_EQUAL(journey->legs[0].wait_time, 5.0);
+  ASSERT_EQUAL(journey->legs[0].ride_time, 10.0);
+  ASSERT_EQUAL(journey->legs[1].bus, "2");
+  ASSERT_EQUAL(journey->legs[1].wait_time, 2.0);
+  ASSERT_EQUAL(journey->legs[1].span, 1u);
+
+  // Last bus to C has already gone
+  ASSERT(!network->GetTimetableRoute("A", "C", 11).has_value());
+
+  // Staying in the bus while it turns around at B
+  auto back = network->GetTimetableRoute("A", "A", 0);
+  ASSERT_EQUAL(back->legs.size(), 0u);
+  auto round_trip = network->GetTimetableRoute("B", "A", 26);
+  ASSERT_EQUAL(round_trip->total_time, 34.0);
+  ASSERT_EQUAL(round_trip->legs[0].span, 1u);
+}
+
+void RouteViaConcatenatesLegs() {
+  using namespace bus;
+
+  BusManagerWithRouter manager(30, 6);
+  manager.AddStop("A", {55.60, 37.20}, {{"B", 2000}});
+  manager.AddStop("B", {55.61, 37.21}, {{"C", 3000}});
+  manager.AddStop("C", {55.62, 37.22});
+  manager.AddBus("1", {"A", "B", "C"}, BusRecord::RouteType::Linear);
+  auto network = manager.Freeze();
+
+  GetRouteViaInfoRequest request;
+  request.stops_ = {"A", "C", "B"};
+  auto info = request.Process(*network);
+  ASSERT_EQUAL(info.error_code_, 0);
+  ASSERT_EQUAL(info.route_items_.size(), 4u);
+  ASSERT(std::abs(info.total_time_ - (6 + 10 + 6 + 6)) < 1e-9);
+
+  request.stops_ = {"A", "D"};
+  ASSERT_EQUAL(request.Process(*network).error_code_, kErrorNotFound);
+
+  // A single waypoint is an empty route if it exists
+  request.stops_ = {"B"};
+  info = request.Process(*network);
+  ASSERT_EQUAL(info.error_code_, 0);
+  ASSERT(info.route_items_.empty());
+  request.stops_ = {"D"};
+  ASSERT_EQUAL(request.Process(*network).error_code_, kErrorNotFound);
+}
+
+void BusStatsPrecomputed() {
+  using namespace bus;
+
+  BusManager manager;
+  manager.AddStop("stop1", {55.611087, 37.20829}, {{"stop2", 3900}});
+  manager.AddStop("stop2", {55.595884, 37.209755}, {{"stop3", 9900}});
+  manager.AddStop("stop3", {55.632761, 37.333324});
+  manager.AddBus("750", {"stop1", "stop2", "stop2", "stop3"}, BusRecord::RouteType::Linear);
+
+  const BusRecord& bus = manager.GetBus("750").value();
+  const auto lazy = bus.GetStats(manager.GetStops(), manager.GetDistances());
+  manager.FinishLoading();
+  const auto stored = bus.GetStats(manager.GetStops(), manager.GetDistances());
+
+  ASSERT_EQUAL(stored.route_length, 27600.0);
+  ASSERT_EQUAL(stored.route_length, lazy.route_length);
+  ASSERT_EQUAL(stored.geom_length, lazy.geom_length);
+  ASSERT_EQUAL(stored.stops_on_route, 7u);
+  ASSERT_EQUAL(stored.unique_stops, 3u);
+}
+
+void RoadDistancesFreeze() {
+  using namespace bus;
+
+  BusManager manager;
+  manager.AddStop("stop1", {1.0, 1.0}, {{"stop2", 100}, {"stop3", 300}});
+  manager.AddStop("stop2", {1.0, 2.0}, {{"stop1", 200}});
+  manager.AddStop("stop3", {-1.0, 1.0});
+
+  const auto& distances = manager.GetDistances();
+  ASSERT_EQUAL(distances.Get(0, 1).value(), 100u);
+  ASSERT_EQUAL(distances.Get(1, 0).value(), 200u);
+
+  manager.FinishLoading();
+  ASSERT(distances.IsFrozen());
+  ASSERT_EQUAL(distances.Get(0, 1).value(), 100u);
+  ASSERT_EQUAL(distances.Get(1, 0).value(), 200u);
+  ASSERT_EQUAL(distances.Get(2, 0).value(), 300u);
+  ASSERT(!distances.Get(1, 2).has_value());
+  ASSERT(!distances.Get(7, 0).has_value());
+
+  RoadDistanceTable pending;
+  pending.Set(0, 1, UINT32_MAX);
+  ASSERT_EQUAL(pending.Get(0, 1).value(), size_t{UINT32_MAX});
+  for (size_t meters : {size_t{UINT32_MAX} + 1, SIZE_MAX}) {
+    try {
+      pending.Set(0, 1, meters);
+      ASSERT(false);
+    } catch (const std::out_of_range&) {
+    }
+    try {
+      pending.SetIfNotExist(1, 0, meters);
+      ASSERT(false);
+    } catch (const std::out_of_range&) {
+    }
+  }
+  ASSERT_EQUAL(pending.Get(0, 1).value(), size_t{UINT32_MAX});
+  ASSERT(!pending.Get(1, 0).has_value());
+}
+
+void BatchHaversine() {
+  using namespace bus;
+
+  BusManager manager;
+  const std::vector<Coordinates> places = {
+      {55.611087, 37.20829},  {55.595884, 37.209755}, {55.632761, 37.333324},
+      {55.574371, 37.6517},   {55.581065, 37.64839},  {55.587655, 37.645687},
+      {55.592028, 37.653656}, {55.580999, 37.659164}, {55.580999, 37.659165}};
+  std::vector<StopId> line;
+  for (size_t i = 0; i < places.size(); ++i) {
+    manager.AddStop("stop" + std::to_string(i), places[i]);
+    line.push_back(static_cast<StopId>(i));
+  }
+  line.push_back(0);
+
+  CoordinateTable coordinates;
+  coordinates.Build(manager.GetStops());
+  ASSERT_EQUAL(coordinates.Size(), places.size());
+
+  std::vector<double> batch(line.size() - 1);
+  coordinates.ConsecutiveDistances(line.data(), line.size(), batch.data(),
+                                   HaversineKernel::SCALAR);
+  for (size_t i = 0; i + 1 < line.size(); ++i) {
+    const double expected =
+        HaversineDistance(places[line[i]], places[line[i + 1]]);
+    ASSERT_EQUAL(batch[i], expected);
+    // Law of cosines used before agrees for stops kilometres apart and is
+    // off by decimetres for close ones
+    const double lat1 = GradToRad(places[line[i]].latitude);
+    const double lat2 = GradToRad(places[line[i + 1]].latitude);
+    const double dlon = GradToRad(places[line[i]].longitude - places[line[i + 1]].longitude);
+    const double cosines = std::acos(std::sin(lat1) * std::sin(lat2) +
+                                     std::cos(lat1) * std::cos(lat2) * std::cos(dlon)) *
+                           6371000;
+    ASSERT(std::abs(batch[i] - cosines) <= (expected > 1000 ? 1e-9 * expected : 0.5));
+  }
+  // Last but one pair is 1e-6 degree of longitude apart
+  ASSERT(std::abs(batch[batch.size() - 2] - 0.0628) < 1e-3);
+  const double length = CalculateLength(line.begin(), line.end(), manager.GetStops());
+  ASSERT(std::abs(coordinates.LineLength(line) - length) <= 1e-12 * length);
+  ASSERT_EQUAL(coordinates.Distance(3, 3), 0.0);
+
+  // Vector kernel against the scalar one over the whole globe, both
+  // branches of asin and a tail shorter than a vector included
+  BusManager world;
+  std::mt19937 generator(34);
+  std::uniform_real_distribution<double> latitude(-90, 90);
+  std::uniform_real_distribution<double> longitude(-180, 180);
+  std::vector<StopId> ids;
+  for (StopId stop = 0; stop < 1003; ++stop) {
+    world.AddStop("stop" + std::to_string(stop), {latitude(generator), longitude(generator)});
+    ids.push_back(stop);
+  }
+  const Coordinates first = world.GetStops()[0].GetCoordinates();
+  world.AddStop("antipode", {-first.latitude, first.longitude + (first.longitude < 0 ? 180 : -180)});
+  ids.push_back(0);
+  ids.push_back(1003);
+  CoordinateTable globe;
+  globe.Build(world.GetStops());
+  std::vector<double> scalar(ids.size() - 1);
+  std::vector<double> avx2(ids.size() - 1);
+  globe.ConsecutiveDistances(ids.data(), ids.size(), scalar.data(),
+                             HaversineKernel::SCALAR);
+  globe.ConsecutiveDistances(ids.data(), ids.size(), avx2.data(),
+                             HaversineKernel::AVX2);
+  for (size_t i = 0; i < scalar.size(); ++i) {
+    ASSERT(std::abs(avx2[i] - scalar[i]) <= 1e-12 * scalar[i] + 1e-9);
+  }
+  // half the circumference, asin near 1 keeps only half the digits of h
+  ASSERT(std::abs(scalar.back() - 3.141592653589793 * 6371000) < 0.5);
+}
+
+void NamePoolInterns() {
+  using namespace bus;
+
+  NamePool pool;
+  const NameId first = pool.Intern("stop1");
+  const std::string_view view = pool.Get(first);
+  for (size_t i = 0; i < 5000; ++i) {
+    pool.Intern("name" + std::to_string(i));
+  }
+  ASSERT_EQUAL(pool.Intern(std::string("stop1")), first);
+  ASSERT_EQUAL(pool.Get(first).data(), view.data());
+  ASSERT_EQUAL(pool.Find("name4999").value(), 5000u);
+  ASSERT(!pool.Find("name5000").has_value());
+  ASSERT_EQUAL(pool.Size(), 5001u);
+
+  // Stop and bus with the same name share it
+  BusManager manager;
+  manager.AddStop("750", {55.611087, 37.20829});
+  manager.AddBus("750", {"750"}, BusRecord::RouteType::Circular);
+  const BusRecord& bus = manager.GetBus("750").value();
+  const StopRecord& stop = manager.GetStop("750").value();
+  ASSERT_EQUAL(bus.GetName().data(), stop.GetName().data());
+  ASSERT_EQUAL(manager.GetNames().Size(), 1u);
+}
+
+void NamePoolPerfectHash() {
+  using namespace bus;
+
+  NamePool pool;
+  for (size_t i = 0; i < 20000; ++i) {
+    pool.Intern("stop " + std::to_string(i));
+  }
+  pool.Intern("");
+  pool.Freeze();
+  ASSERT(pool.IsFrozen());
+
+  for (NameId id = 0; id < 20000; ++id) {
+    ASSERT_EQUAL(pool.Find("stop " + std::to_string(id)).value(), id);
+  }
+  ASSERT_EQUAL(pool.Find("").value(), 20000u);
+  ASSERT(!pool.Find("stop 20000").has_value());
+  ASSERT(!pool.Find("stop").has_value());
+  ASSERT_EQUAL(pool.Intern("stop 7"), 7u);
+  try {
+    pool.Intern("new stop");
+    ASSERT(false);
+  } catch (const std::logic_error&) {
+  }
+
+  NamePool empty;
+  empty.Freeze();
+  ASSERT(!empty.Find("stop").has_value());
+}
+
+void StopBusesSorted() {
+  using namespace bus;
+
+  BusManager manager;
+  manager.AddStop("stop1", {55.611087, 37.20829});
+  manager.AddStop("stop2", {55.595884, 37.209755});
+  manager.AddStop("lonely", {55.632761, 37.333324});
+  manager.AddBus("b", {"stop1", "stop2", "stop1"}, BusRecord::RouteType::Circular);
+  manager.AddBus("a", {"stop2", "stop1"}, BusRecord::RouteType::Linear);
+  manager.AddBus("10", {"stop2"}, BusRecord::RouteType::Linear);
+
+  try {
+    (void)manager.GetStopBuses(0);
+    ASSERT(false);
+  } catch (const std::logic_error&) {
+  }
+  manager.FinishLoading();
+
+  auto names = [&manager](std::string_view stop) {
+    std::vector<std::string_view> result;
+    const auto id = manager.GetStop(stop)->get().GetId();
+    for (NameId bus : manager.GetStopBuses(id)) {
+      result.push_back(manager.GetNames().Get(bus));
+    }
+    return result;
+  };
+  ASSERT_EQUAL(names("stop1"), (std::vector<std::string_view>{"a", "b"}));
+  ASSERT_EQUAL(names("stop2"), (std::vector<std::string_view>{"10", "a", "b"}));
+  ASSERT(names("lonely").empty());
+
+  // Nothing is built twice
+  manager.FinishLoading();
+  ASSERT_EQUAL(names("stop2"), (std::vector<std::string_view>{"10", "a", "b"}));
+}
+
+void FrozenNetworkServesReads() {
+  using namespace bus;
+
+  BusManager manager;
+  manager.AddStop("stop1", {55.611087, 37.20829}, {{"stop2", 3900}});
+  manager.AddStop("stop2", {55.595884, 37.209755});
+  manager.AddStop("lonely", {55.632761, 37.333324});
+  manager.AddBus("750", {"stop1", "stop2"}, BusRecord::RouteType::Linear);
+  auto network = manager.Freeze();
+
+  // Build-time data is handed over
+  ASSERT_EQUAL(manager.GetStopCount(), 0u);
+  ASSERT(!manager.GetBus("750").has_value());
+
+  const FrozenBus& bus = network->FindBus("750").value();
+  ASSERT_EQUAL(network->GetNames().Get(bus.name), "750");
+  ASSERT_EQUAL(bus.stats.route_length, 7800.0);
+  ASSERT_EQUAL(bus.stats.stops_on_route, 3u);
+  const auto stops = network->GetBusStops(bus);
+  ASSERT_EQUAL(stops.size(), 2u);
+  ASSERT_EQUAL(network->GetStopName(stops[1]), "stop2");
+  ASSERT(!network->FindBus("stop1").has_value());
+  ASSERT(!network->FindStop("750").has_value());
+  ASSERT_EQUAL(network->GetDistances().Get(stops[1], stops[0]).value(), 3900u);
+
+  GetStopInfoRequest request;
+  request.name_ = "lonely";
+  auto info = request.Process(*network);
+  ASSERT_EQUAL(info.error_code_, 0);
+  ASSERT(info.buses_->empty());
+  request.name_ = "stop3";
+  ASSERT_EQUAL(request.Process(*network).error_code_, kErrorNotFound);
+
+  // Without router only stop and bus requests are served
+  ASSERT(!network->GetRoute("stop1", "nowhere").has_value());
+  try {
+    (void)network->GetRoute("stop1", "stop2");
+    ASSERT(false);
+  } catch (const std::runtime_error&) {
+  }
+}
+
+void PublisherSwapsSnapshots() {
+  using namespace bus;
+
+  auto factory = [] {
+    return std::make_unique<BusManagerWithRouter>(40, 6);
+  };
+  auto manager = factory();
+  manager->AddStop("stop1", {55.611087, 37.20829}, {{"stop2", 3900}});
+  manager->AddStop("stop2", {55.595884, 37.209755});
+  manager->AddBus("750", {"stop1", "stop2"}, BusRecord::RouteType::Linear);
+  NetworkPublisher publisher(factory, manager->Freeze());
+  const auto old_network = publisher.Get();
+
+  // Readers keep answering while the next snapshot is built
+  std::atomic<bool> stop{false};
+  std::vector<std::future<size_t>> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.push_back(std::async(std::launch::async, [&publisher, &stop] {
+      NetworkPublisher::Reader reader(publisher);
+      size_t served = 0;
+      while (!stop.load() || served == 0) {
+        const FrozenNetwork& network = reader.Get();
+        ASSERT_EQUAL(network.FindBus("750")->get().stats.route_length, 7800.0);
+        ++served;
+      }
+      return served;
+    }));
+  }
+
+  publisher.Update([](BusManager& next) {
+    next.AddStop("stop3", {55.632761, 37.333324}, {{"stop2", 1000}});
+    next.AddBus("828", {"stop2", "stop3"}, BusRecord::RouteType::Linear);
+  }).get();
+  stop = true;
+  for (auto& reader : readers) {
+    ASSERT(reader.get() > 0);
+  }
+
+  ASSERT_EQUAL(publisher.GetVersion(), 1u);
+  const auto network = publisher.Get();
+  ASSERT(network != old_network);
+  ASSERT_EQUAL(network->FindStop("stop2").value(), old_network->FindStop("stop2").value());
+  ASSERT_EQUAL(network->FindBus("828")->get().stats.route_length, 2000.0);
+  ASSERT_EQUAL(network->GetStopBuses(*network->FindStop("stop2")).size(), 2u);
+  ASSERT(network->GetRoute("stop1", "stop3").has_value());
+
+  // Old snapshot is untouched and still usable
+  ASSERT(!old_network->FindStop("stop3").has_value());
+  ASSERT(!old_network->GetRoute("stop1", "stop3").has_value());
+
+  // A failed update leaves the snapshot in place
+  auto failed = publisher.Update([](BusManager&) {
+    throw std::runtime_error("bad batch");
+  });
+  try {
+    failed.get();
+    ASSERT(false);
+  } catch (const std::runtime_error&) {
+  }
+  ASSERT(publisher.Get() == network);
+  ASSERT_EQUAL(publisher.GetVersion(), 1u);
+}
+
+void SnapshotRoundTrip() {
+  using namespace bus;
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "route_manager_snapshot.bin").string();
+
+  BusManagerWithRouter manager(30, 6);
+  manager.AddStop("A", {55.60, 37.20}, {{"B", 2000}});
+  manager.AddStop("B", {55.61, 37.21}, {{"C", 3000}});
+  manager.AddStop("C", {55.62, 37.22});
+  manager.AddBus("1", {"A", "B", "C"}, BusRecord::RouteType::Linear);
+  manager.AddBus("2", {"C", "A", "C"}, BusRecord::RouteType::Circular);
+  manager.AddTrip("1", {0, 4, 10, 16, 20});
+  auto network = manager.Freeze();
+  SaveSnapshot(*network, path);
+
+  auto loaded = LoadSnapshot(path);
+  ASSERT_EQUAL(loaded->GetStopCount(), 3u);
+  const FrozenBus& bus = loaded->FindBus("1").value();
+  ASSERT_EQUAL(bus.stats.route_length, network->FindBus("1")->get().stats.route_length);
+  ASSERT_EQUAL(loaded->GetBusStops(bus).size(), 3u);
+  ASSERT_EQUAL(loaded->GetStopBuses(*loaded->FindStop("C")).size(), 2u);
+  ASSERT_EQUAL(loaded->GetDistances().Get(1, 0).value(), 2000u);
+  ASSERT_EQUAL(loaded->GetTrips().size(), 1u);
+  ASSERT_EQUAL(loaded->GetTrips()[0].bus, "1");
+
+  // Routes come from the file and match the computed ones
+  for (std::string_view from : {"A", "B", "C"}) {
+    for (std::string_view to : {"A", "B", "C"}) {
+      auto expected = network->GetRoute(from, to);
+      auto route = loaded->GetRoute(from, to);
+      ASSERT_EQUAL(route.has_value(), expected.has_value());
+      ASSERT_EQUAL(route->weight.time, expected->weight.time);
+      ASSERT_EQUAL(route->edges, expected->edges);
+    }
+  }
+  auto journey = loaded->GetRaptorRoute("A", "C");
+  ASSERT_EQUAL(journey->total_time, network->GetRaptorRoute("A", "C")->total_time);
+  ASSERT_EQUAL(journey->legs[0].bus, "2");
+
+  // Stop indexes are read back instead of built
+  auto nearest = loaded->FindNearestStops({55.601, 37.201}, 2, 10000);
+  ASSERT_EQUAL(nearest.size(), 2u);
+  ASSERT_EQUAL(nearest[0].stop, *loaded->FindStop("A"));
+  ASSERT_EQUAL(nearest[1].stop, *loaded->FindStop("B"));
+  auto found = loaded->SearchStops("D", 1, 1);
+  ASSERT_EQUAL(found.size(), 1u);
+  ASSERT_EQUAL(found[0].stop, network->SearchStops("D", 1, 1)[0].stop);
+
+  // Damaged file is refused
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(100);
+    file.put('\x7f');
+  }
+  try {
+    LoadSnapshot(path);
+    ASSERT(false);
+  } catch (const std::runtime_error&) {
+  }
+  std::filesystem::remove(path);
+}
+
+void SnapshotRejectsBadIndexes() {
+  using namespace bus;
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "route_manager_damaged.bin").string();
+
+  BusManagerWithRouter manager(30, 6);
+  manager.AddStop("A", {55.60, 37.20}, {{"B", 2000}});
+  manager.AddStop("B", {55.61, 37.21}, {{"C", 3000}});
+  manager.AddStop("C", {55.62, 37.22});
+  manager.AddBus("1", {"A", "B", "C"}, BusRecord::RouteType::Linear);
+  manager.AddBus("2", {"C", "A", "C"}, BusRecord::RouteType::Circular);
+  manager.AddTrip("1", {0, 4, 10, 16, 20});
+  manager.AddTrip("2", {1, 5, 9});
+  SaveSnapshot(*manager.Freeze(), path);
+
+  std::string image;
+  {
+    std::ifstream file(path, std::ios::binary);
+    image.assign(std::istreambuf_iterator<char>(file), {});
+  }
+
+  // Offset of the records of a section, tags as in NetworkSnapshot.cpp
+  auto find_section = [&image](uint32_t tag) {
+    size_t pos = 32;
+    while (pos < image.size()) {
+      uint32_t section_tag, record_size;
+      uint64_t count;
+      std::memcpy(&section_tag, image.data() + pos, 4);
+      std::memcpy(&record_size, image.data() + pos + 4, 4);
+      std::memcpy(&count, image.data() + pos + 8, 8);
+      if (section_tag == tag) {
+        return pos + 16;
+      }
+      pos += 16 + (record_size * count + 7) / 8 * 8;
+    }
+    ASSERT(false);
+    return pos;
+  };
+
+  // Damaged copy with the right checksum must still be refused
+  auto expect_refused = [&](size_t offset, auto value) {
+    std::string damaged = image;
+    std::memcpy(damaged.data() + offset, &value, sizeof(value));
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 32; i + 8 <= damaged.size(); i += 8) {
+      uint64_t word;
+      std::memcpy(&word, damaged.data() + i, sizeof(word));
+      hash ^= word;
+      hash *= 1099511628211ull;
+    }
+    std::memcpy(damaged.data() + 24, &hash, sizeof(hash));
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << damaged;
+    try {
+      LoadSnapshot(path);
+      ASSERT(false);
+    } catch (const std::runtime_error&) {
+    }
+  };
+
+  expect_refused(find_section(5), uint32_t{1000});               // name slot
+  expect_refused(find_section(11), uint32_t{1000});              // bus of a stop
+  expect_refused(find_section(12) + 32, uint32_t{3});            // stop position
+  expect_refused(find_section(15) + 8, uint32_t{1000});          // first stop of a bus
+  expect_refused(find_section(20) + 8, uint64_t{9});             // trip offsets go back
+  expect_refused(find_section(22) + 8, uint64_t{100});           // edge to
+  expect_refused(find_section(23) + 8, uint64_t{1000});          // incidence offsets
+
+  // Previous edge out of range and one of a wrong vertex
+  const size_t routes = find_section(25);
+  size_t route = routes;
+  uint64_t prev_edge = UINT64_MAX;
+  while (prev_edge == UINT64_MAX) {
+    std::memcpy(&prev_edge, image.data() + route + 16, sizeof(prev_edge));
+    route += 24;
+  }
+  route -= 24;
+  expect_refused(route + 16, uint64_t{1000});
+  const size_t edges = find_section(22);
+  auto edge_to = [&image, edges](uint64_t edge) {
+    uint64_t to;
+    std::memcpy(&to, image.data() + edges + edge * 32 + 8, sizeof(to));
+    return to;
+  };
+  uint64_t other_edge = 0;
+  while (edge_to(other_edge) == edge_to(prev_edge)) {
+    ++other_edge;
+  }
+  expect_refused(route + 16, other_edge);
+
+  // Image as saved is still fine
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << image;
+  ASSERT_EQUAL(LoadSnapshot(path)->GetTrips().size(), 2u);
+  std::filesystem::remove(path);
+}
+
+void NearestStopsMatchScan() {
+  using namespace bus;
+
+  // Dense city with a few stops near the antimeridian and a pole
+  std::mt19937 generator(41);
+  std::uniform_real_distribution<double> latitude(55.5, 55.9);
+  std::uniform_real_distribution<double> longitude(37.3, 37.9);
+  std::vector<Coordinates> places;
+  for (int i = 0; i < 2000; ++i) {
+    places.push_back({latitude(generator), longitude(generator)});
+  }
+  places.push_back({64.7, 179.99});
+  places.push_back({64.7, -179.99});
+  places.push_back({89.99, 10});
+  SpatialIndex index(places);
+
+  auto scan = [&places](const Coordinates& place, size_t count, double radius) {
+    std::vector<NearbyStop> all;
+    for (StopId stop = 0; stop < places.size(); ++stop) {
+      const double distance = HaversineDistance(place, places[stop]);
+      if (distance <= radius) {
+        all.push_back({stop, distance});
+      }
+    }
+    std::sort(all.begin(), all.end(), [](const NearbyStop& lhs, const NearbyStop& rhs) {
+      return std::pair{lhs.distance, lhs.stop} < std::pair{rhs.distance, rhs.stop};
+    });
+    all.resize(std::min(all.size(), count));
+    return all;
+  };
+
+  std::vector<std::tuple<Coordinates, size_t, double>> queries = {
+      {{64.7, 179.999}, 2, 5000},
+      {{64.7, -179.5}, 1, 1e9},
+      {{89.9, -170}, 1, 50000},
+      {{0, 0}, 3, 1e9},
+      {{55.7, 37.6}, 0, 1000}};
+  for (int i = 0; i < 200; ++i) {
+    queries.push_back({{latitude(generator), longitude(generator)},
+                       static_cast<size_t>(i % 20), i % 3 ? 1500.0 : 1e9});
+  }
+  for (const auto& [place, count, radius] : queries) {
+    const auto expected = scan(place, count, radius);
+    const auto found = index.FindNearest(place, count, radius);
+    ASSERT_EQUAL(found.size(), expected.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+      ASSERT_EQUAL(found[i].stop, expected[i].stop);
+      ASSERT_EQUAL(found[i].distance, expected[i].distance);
+    }
+  }
+
+  // Served as a stat request of the network
+  BusManager manager;
+  manager.AddStop("near", {55.611087, 37.20829});
+  manager.AddStop("far", {55.595884, 37.209755});
+  auto network = manager.Freeze();
+  GetNearestStopsRequest request;
+  request.place_ = {55.611, 37.2083};
+  request.count_ = 5;
+  request.radius_ = 1000;
+  auto info = request.Process(*network);
+  ASSERT_EQUAL(info.stops_.size(), 1u);
+  ASSERT_EQUAL(info.stops_[0].first, "near");
+}
+
+void StopSearchMatchesScan() {
+  using namespace bus;
+
+  NamePool names;
+  std::vector<NameId> stop_names;
+  for (std::string_view name :
+       {"Marushkino", "Rasskazovka", "Biryusinka", "Biryulyovo Zapadnoye",
+        "Biryulyovo Tovarnaya", "Universam", "Tolstopaltsevo", "Biryulyovo",
+        "Apteka", "Aptekarskaya", "Apt", "Zapadnoye", "Biryulyovo"}) {
+    stop_names.push_back(names.Intern(name));
+  }
+  StopNameIndex index(names, stop_names);
+
+  auto to_names = [&](const std::vector<StopMatch>& matches) {
+    std::vector<std::string> result;
+    for (const auto& match : matches) {
+      result.push_back(std::string(names.Get(stop_names[match.stop])));
+    }
+    return result;
+  };
+  using Names = std::vector<std::string>;
+
+  ASSERT_EQUAL(to_names(index.FindByPrefix("Biryu", 3)),
+               (Names{"Biryulyovo", "Biryulyovo", "Biryulyovo Tovarnaya"}));
+  ASSERT_EQUAL(to_names(index.FindByPrefix("Apt", 10)),
+               (Names{"Apt", "Apteka", "Aptekarskaya"}));
+  ASSERT(index.FindByPrefix("Moscow", 10).empty());
+  ASSERT_EQUAL(index.FindByPrefix("", 100).size(), stop_names.size());
+
+  // One typo in the prefix, exact prefixes go first
+  auto matches = index.FindFuzzy("Biryul", 4, 1);
+  ASSERT_EQUAL(to_names(matches), (Names{"Biryulyovo", "Biryulyovo",
+                                         "Biryulyovo Tovarnaya",
+                                         "Biryulyovo Zapadnoye"}));
+  ASSERT_EQUAL(to_names(index.FindFuzzy("Birjusinka", 2, 1)), (Names{"Biryusinka"}));
+  ASSERT_EQUAL(index.FindFuzzy("Birjusinka", 2, 1)[0].edits, 1u);
+  ASSERT_EQUAL(to_names(index.FindFuzzy("Unvirsam", 2, 2)), (Names{"Universam"}));
+  ASSERT(index.FindFuzzy("Unvirsam", 2, 1).empty());
+
+  // Against a scan over all names with random queries
+  auto prefix_edits = [](std::string_view query, std::string_view name) {
+    std::vector<uint32_t> row(query.size() + 1);
+    for (size_t j = 0; j < row.size(); ++j) {
+      row[j] = static_cast<uint32_t>(j);
+    }
+    uint32_t best = row.back();
+    for (size_t i = 0; i < name.size(); ++i) {
+      std::vector<uint32_t> next(row.size());
+      next[0] = static_cast<uint32_t>(i + 1);
+      for (size_t j = 1; j < row.size(); ++j) {
+        next[j] = std::min({row[j] + 1, next[j - 1] + 1,
+                            row[j - 1] + (name[i] != query[j - 1])});
+      }
+      row = std::move(next);
+      best = std::min(best, row.back());
+    }
+    return best;
+  };
+  std::mt19937 generator(42);
+  for (int i = 0; i < 300; ++i) {
+    std::string query(names.Get(stop_names[generator() % stop_names.size()]));
+    query.resize(generator() % (query.size() + 1));
+    if (!query.empty()) {
+      query[generator() % query.size()] = static_cast<char>('a' + generator() % 26);
+    }
+    const uint32_t max_edits = generator() % 3;
+    const size_t count = generator() % 6;
+
+    std::vector<std::tuple<uint32_t, std::string_view, StopId>> expected;
+    for (StopId stop = 0; stop < stop_names.size(); ++stop) {
+      const auto name = names.Get(stop_names[stop]);
+      if (const uint32_t edits = prefix_edits(query, name); edits <= max_edits) {
+        expected.emplace_back(edits, name, stop);
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.resize(std::min(expected.size(), count));
+
+    const auto found = index.FindFuzzy(query, count, max_edits);
+    ASSERT_EQUAL(found.size(), expected.size());
+    for (size_t j = 0; j < found.size(); ++j) {
+      ASSERT_EQUAL(found[j].stop, std::get<2>(expected[j]));
+      ASSERT_EQUAL(found[j].edits, std::get<0>(expected[j]));
+    }
+  }
+}
+
 void AddBusRequestParser() {
   std::string line =
       "Bus 256: Biryulyovo Zapadnoye > Biryusinka > Universam > Biryulyovo "
@@ -174,6 +1008,66 @@ void AddStopRequestParser() {
           std::make_pair<std::string, size_t>("Universam", 2400)));
 }
 
+void AddTripRequestParser() {
+  AddTripRequest request{};
+  request.ParseFrom("Trip 828 night: 0, 4.5, 10, 16");
+  ASSERT_EQUAL(request.bus_, "828 night");
+  ASSERT_EQUAL(request.times_, (std::vector<double>{0, 4.5, 10, 16}));
+}
+
+void GetRouteViaRequestParser() {
+  GetRouteViaInfoRequest request{};
+  request.ParseFrom("RouteVia Biryusinka > Universam > Biryulyovo Zapadnoye");
+  ASSERT_EQUAL(request.stops_, (std::vector<std::string>{"Biryusinka", "Universam",
+                                                         "Biryulyovo Zapadnoye"}));
+}
+
+void GetNearestStopsRequestParser() {
+  GetNearestStopsRequest request{};
+  request.ParseFrom("NearestStops 55.611087, 37.20829, 3");
+  ASSERT_EQUAL(request.place_.latitude, 55.611087);
+  ASSERT_EQUAL(request.place_.longitude, 37.20829);
+  ASSERT_EQUAL(request.count_, 3u);
+
+  GetNearestStopsRequest within{};
+  within.ParseFrom("NearestStops 55.611087, 37.20829, 2, 1500m");
+  ASSERT_EQUAL(within.count_, 2u);
+  ASSERT_EQUAL(within.radius_, 1500.0);
+}
+
+void StopSearchRequestParser() {
+  StopSearchRequest request{};
+  request.ParseFrom("StopSearch 5: Universam");
+  ASSERT_EQUAL(request.query_, "Universam");
+  ASSERT_EQUAL(request.count_, 5u);
+  ASSERT_EQUAL(request.max_edits_, 0u);
+
+  StopSearchRequest fuzzy{};
+  fuzzy.ParseFrom("StopSearch 3, 2 edits: Univrsam");
+  ASSERT_EQUAL(fuzzy.count_, 3u);
+  ASSERT_EQUAL(fuzzy.max_edits_, 2u);
+
+  for (std::string_view line : {"StopSearch 3, 4 edits: Uni",
+                                "StopSearch 3, -1 edits: Uni"}) {
+    try {
+      StopSearchRequest{}.ParseFrom(line);
+      ASSERT(false);
+    } catch (const std::runtime_error&) {
+    }
+  }
+  for (std::string_view edits : {"-1", "4", "4294967296"}) {
+    const std::string text =
+        R"({"query": "Uni", "count": 3, "id": 1, "max_edits": )" +
+        std::string(edits) + "}";
+    const auto doc = Json::LoadValues(text);
+    try {
+      StopSearchRequest{}.ParseFromJson(doc.GetRoot());
+      ASSERT(false);
+    } catch (const std::runtime_error&) {
+    }
+  }
+}
+
 void GetBusRequestParser() {
   std::string line = "Bus 256";
   GetBusInfoRequest request{};
@@ -302,6 +1196,525 @@ void ToJsonAndBack() {
   ASSERT_EQUAL(first, second);
 }
 
+void BufferLoadMatchesStream() {
+  using namespace Json;
+  auto print = [](const Node& node) {
+    std::ostringstream out;
+    ToJson(node, out);
+    return out.str();
+  };
+
+  const std::string text = R"({"routing_settings": {"bus_wait_time": 6, "bus_velocity": 40.5},
+    "base_requests": [{"type": "Stop", "name": "Tolstopaltsevo", "latitude": 55.611087,
+      "longitude": -37.20829, "road_distances": {"Marushkino": 3900}},
+      {"type": "Bus", "name": "256", "stops": [], "is_roundtrip": false}],
+    "stat_requests": [{"type": "Bus", "name": "256", "id": 1965312327, "flag": true},
+      {"id": 0, "id": 1, "list": [[], {}, [0.5, -0, 12]]}]})";
+  std::istringstream input(text);
+  ASSERT_EQUAL(print(Load(std::string_view(text)).GetRoot()),
+               print(Load(input).GetRoot()));
+
+  // Whitespace of any kind, escapes and exponents
+  auto doc = Load(std::string_view(
+      "\r\n\t [ \"a\\\"b\\\\c\\/\\n\" , \"\\u0041\\u00e9\\u20ac\\ud83d\\ude80\",\t1.5e3 ,-2E-2 ]\r\n"));
+  const auto& array = doc.GetRoot().AsArray();
+  ASSERT_EQUAL(array.size(), 4u);
+  ASSERT_EQUAL(array[0].AsString(), "a\"b\\c/\n");
+  ASSERT_EQUAL(array[1].AsString(), "A\xC3\xA9\xE2\x82\xAC\xF0\x9F\x9A\x80");
+  ASSERT_EQUAL(array[2].AsDouble(), 1500.0);
+  ASSERT_EQUAL(array[3].AsDouble(), -0.02);
+
+  for (std::string_view bad : {"", "[1, 2", "{\"a\" 1}", "\"abc", "[1] 2", "nul",
+                               "\"\\x\"", "\"\\ud83d\""}) {
+    bool thrown = false;
+    try {
+      Load(bad);
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    ASSERT(thrown);
+  }
+}
+
+void StructuralIndexMatchesReader() {
+  using namespace Json;
+  const std::vector<ScanKernel> kernels = {ScanKernel::SCALAR, GetScanKernel()};
+  auto find_all = [&kernels](std::string_view text) {
+    const auto structurals = FindStructurals(text, kernels[0]);
+    ASSERT_EQUAL(FindStructurals(text, kernels[1]), structurals);
+    return structurals;
+  };
+
+  // Inside of strings and the rest of scalars are left out, escaped
+  // quotes do not close strings
+  ASSERT_EQUAL(find_all(R"( {"a\"b": [12, true,"x\\"]} )"),
+               (std::vector<uint32_t>{1, 2, 8, 10, 11, 13, 15, 19, 20, 25, 26}));
+  ASSERT_EQUAL(find_all(""), std::vector<uint32_t>{});
+
+  // Runs of backslashes and strings crossing 64 byte blocks
+  std::string text = "[";
+  for (int i = 0; i < 200; ++i) {
+    text += "\"" + std::string(i % 70, 'x') + std::string(i % 5, '\\') +
+            (i % 5 % 2 ? "\\\", " : "\", ") + std::to_string(i * 7) + " ,";
+  }
+  text += "null]";
+  std::vector<uint32_t> expected = {0};
+  for (size_t pos = 1; pos < text.size();) {
+    if (text[pos] == '"') {
+      expected.push_back(pos);
+      for (++pos; text[pos] != '"'; ++pos) {
+        pos += text[pos] == '\\';
+      }
+      ++pos;
+    } else if (text[pos] == ' ') {
+      ++pos;
+    } else {
+      expected.push_back(pos);
+      pos = std::isdigit(text[pos]) || text[pos] == 'n'
+                ? text.find_first_of(" ,]", pos) : pos + 1;
+    }
+  }
+  ASSERT_EQUAL(find_all(text), expected);
+
+  bool thrown = false;
+  try {
+    FindStructurals("[\"abc\\\"]");
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+
+  // The indexed reader builds what the plain one does and rejects the same
+  auto print = [](const Node& node) {
+    std::ostringstream out;
+    ToJson(node, out);
+    return out.str();
+  };
+  const std::string sample = R"({"base_requests": [{"type": "Stop", "name": "Tolstopaltsevo",
+      "latitude": 55.611087, "road_distances": {"Marushkino": 3900}}],
+    "z": [true, false, "a\"b\\", "A", -1.5e2, [], {}]})";
+  Reader reader(sample, FindStructurals(sample));
+  ASSERT_EQUAL(print(reader.ReadNode()), print(Load(std::string_view(sample)).GetRoot()));
+  reader.Finish();
+
+  for (std::string_view bad : {"[1, 2", "{\"a\" 1}", "[1] 2", "[12abc]", "[true1]",
+                               "[\"a\"b]", "nul"}) {
+    thrown = false;
+    try {
+      Reader bad_reader(bad, FindStructurals(bad));
+      bad_reader.ReadNode();
+      bad_reader.Finish();
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    ASSERT(thrown);
+  }
+}
+
+void ParallelRequestsKeepOrder() {
+  using namespace bus;
+  auto split = [](std::string_view text) {
+    Json::Reader reader(text, Json::FindStructurals(text));
+    auto elements = reader.SplitArray();
+    reader.Finish();
+    return elements;
+  };
+  ASSERT_EQUAL(split(" [ ] "), std::vector<std::string_view>{});
+  ASSERT_EQUAL(split(R"([1 , [2, "]"], {"a": [{}]},"x,y"])"),
+               (std::vector<std::string_view>{"1 ", R"([2, "]"])", R"({"a": [{}]})",
+                                              R"("x,y")"}));
+  // Batches of any size give the same elements
+  for (size_t batch_size : {1, 2, 3, 4, 10}) {
+    std::string_view text = R"( [1 , [2, "]"], {"a": [{}]},"x,y"] )";
+    Json::Reader reader(text, Json::FindStructurals(text));
+    std::vector<std::string_view> elements;
+    size_t batches = 0;
+    reader.SplitArray(batch_size, [&](std::span<const std::string_view> batch) {
+      ASSERT(!batch.empty() && batch.size() <= batch_size);
+      elements.insert(elements.end(), batch.begin(), batch.end());
+      ++batches;
+    });
+    reader.Finish();
+    ASSERT_EQUAL(elements, split(text));
+    ASSERT_EQUAL(batches, (4 + batch_size - 1) / batch_size);
+  }
+  // Elements are checked by their own readers
+  ASSERT_EQUAL(split("[1,]"), (std::vector<std::string_view>{"1", ""}));
+  for (std::string_view bad : {"[1}", "[[1]", "{}"}) {
+    bool thrown = false;
+    try {
+      split(bad);
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    ASSERT(thrown);
+  }
+  bool thrown = false;
+  try {
+    Json::Reader("[]").SplitArray();
+  } catch (const std::logic_error&) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+
+  std::string text = R"({"base_requests": [)";
+  for (int i = 0; i < 20; ++i) {
+    const std::string name = "Stop " + std::to_string(i);
+    const std::string next = "Stop " + std::to_string((i + 1) % 20);
+    text += R"({"type": "Stop", "name": ")" + name + R"(", "latitude": 55.)" +
+            std::to_string(i) + R"(, "longitude": 37.5, "road_distances": {")" + next +
+            R"(": )" + std::to_string(100 + i) + "}},\n";
+    text += R"({"type": "Bus", "name": "Bus )" + std::to_string(i) + R"(", "stops": [")" +
+            name + R"(", ")" + next + R"("], "is_roundtrip": false},)";
+  }
+  text.back() = ']';
+  text += R"(, "stat_requests": [)";
+  for (int i = 0; i < 30; ++i) {
+    text += R"({"type": ")" + std::string(i % 2 ? "Bus" : "Stop") + R"(", "name": ")" +
+            (i % 2 ? "Bus " : "Stop ") + std::to_string(i % 25) + R"(", "id": )" +
+            std::to_string(i) + (i < 29 ? "}, " : "}]}");
+  }
+
+  const auto doc = Json::LoadValues(text);
+  const auto& root = doc.GetRoot().AsMap();
+  BusManager sequential;
+  ProcessModifyRequests(ParseRequests(STR_TO_MOD_REQUEST_TYPE, root.at("base_requests")),
+                        sequential);
+  const auto expected_network = sequential.Freeze();
+  auto answer = [](const std::vector<Request::RequestHolder>& requests,
+                   const FrozenNetwork& network) {
+    std::ostringstream out;
+    {
+      Json::Writer writer(out, true);
+      ProcessReadRequestsToJson(requests, network, writer);
+    }
+    return out.str();
+  };
+  const std::string expected =
+      answer(ParseRequests(STR_TO_READ_REQUEST_TYPE, root.at("stat_requests")),
+             *expected_network);
+
+  for (size_t thread_count : {1, 3, 8}) {
+    Json::Reader reader(text, Json::FindStructurals(text));
+    BusManager manager;
+    std::vector<Request::RequestHolder> read_requests;
+    reader.ReadObject([&](std::string_view key) {
+      if (key == "base_requests") {
+        // Batches smaller than the array, the last one may be short
+        reader.SplitArray(thread_count + 4, [&](std::span<const std::string_view> batch) {
+          ASSERT(!batch.empty() && batch.size() <= thread_count + 4);
+          ProcessModifyRequests(
+              ParseRequestsParallel(STR_TO_MOD_REQUEST_TYPE, batch, thread_count), manager);
+        });
+      } else {
+        read_requests =
+            ParseRequestsParallel(STR_TO_READ_REQUEST_TYPE, reader.SplitArray(), thread_count);
+      }
+    });
+    reader.Finish();
+    const auto network = manager.Freeze();
+    ASSERT_EQUAL(read_requests.size(), 30u);
+    ASSERT_EQUAL(network->GetStopCount(), expected_network->GetStopCount());
+    ASSERT_EQUAL(answer(read_requests, *network), expected);
+  }
+}
+
+void NumbersReadExactly() {
+  using namespace Json;
+  // Full precision doubles come back bit for bit from every loader
+  std::mt19937_64 generator(7);
+  std::uniform_real_distribution<double> coordinate(-180, 180);
+  std::string text = "[";
+  std::vector<double> expected;
+  for (int i = 0; i < 1000; ++i) {
+    double value = coordinate(generator);
+    if (i % 3 == 0) {
+      value = std::ldexp(value, static_cast<int>(generator() % 200) - 100);
+    }
+    expected.push_back(value);
+    std::ostringstream out;
+    out << std::setprecision(17) << value;
+    text += out.str() + (i % 2 ? ", " : ",");
+  }
+  text += "55.611087, 2.5e-3, 1E+2, 1e400, -1e-400]";
+  expected.insert(expected.end(), {55.611087, 0.0025, 100.0,
+                                   std::numeric_limits<double>::infinity(), -0.0});
+
+  std::istringstream input(text);
+  const auto stream = Load(input);
+  const auto buffer = Load(std::string_view(text));
+  const auto values = LoadValues(text);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQUAL(stream.GetRoot().AsArray()[i].AsDouble(), expected[i]);
+    ASSERT_EQUAL(buffer.GetRoot().AsArray()[i].AsDouble(), expected[i]);
+    ASSERT_EQUAL(values.GetRoot().AsArray()[i].AsDouble(), expected[i]);
+  }
+  ASSERT(std::signbit(values.GetRoot().AsArray().back().AsDouble()));
+
+  // Plain integers keep every digit while they fit size_t
+  const auto integers =
+      LoadValues("[0, 1965312327, 18446744073709551615, 18446744073709551616, -1, 1.0]");
+  const auto array = integers.GetRoot().AsArray();
+  ASSERT_EQUAL(array[0].AsInt(), 0u);
+  ASSERT_EQUAL(array[1].AsInt(), 1965312327u);
+  ASSERT_EQUAL(array[2].AsInt(), std::numeric_limits<size_t>::max());
+  ASSERT_EQUAL(array[3].AsDouble(), 18446744073709551616.0);
+  for (size_t i = 3; i < array.size(); ++i) {
+    ASSERT(array[i].GetKind() == Value::Kind::NUMBER);
+  }
+  ASSERT_EQUAL(array[4].AsDouble(), -1.0);
+  ASSERT_EQUAL(array[1].AsDouble(), 1965312327.0);
+  ASSERT_EQUAL(Load(std::string_view("[18446744073709551615]")).GetRoot().AsArray()[0].AsInt(),
+               std::numeric_limits<size_t>::max());
+
+  bool thrown = false;
+  try {
+    (void)array[4].AsInt();
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+
+  // Road distances take whole numbers however they are written
+  const auto whole = LoadValues("[3000, 3000.0, 3e3, 2.5, -3, 1e20, -0.0, \"3\"]");
+  const auto distances = whole.GetRoot().AsArray();
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_EQUAL(distances[i].AsIntegral(), 3000u);
+  }
+  ASSERT_EQUAL(distances[6].AsIntegral(), 0u);
+  for (size_t i : {3, 4, 5, 7}) {
+    thrown = false;
+    try {
+      (void)distances[i].AsIntegral();
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    ASSERT(thrown);
+  }
+
+  for (std::string_view bad : {"1.", "1e", "-", ".5", "1e+", "--1"}) {
+    thrown = false;
+    try {
+      Load(bad);
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    ASSERT(thrown);
+  }
+}
+
+void ValueTreeMatchesNode() {
+  using namespace Json;
+  auto print = [](const auto& node) {
+    std::ostringstream out;
+    ToJson(node, out);
+    return out.str();
+  };
+
+  std::string text = R"({"stat_requests": [{"type": "Bus", "name": "256", "id": 1965312327},
+    {"type": "Route", "from": "Biryulyovo\u0020Zapadnoye", "to": "Universam", "id": 4}],
+    "z": {"k": [true, false, -1.5e2, [], {}], "k": 0, "a\"b": "c\nd"}, "big": {)";
+  for (int i = 20; i > 0; --i) {
+    text += "\"key" + std::to_string(i) + "\": " + std::to_string(i) + (i > 1 ? ", " : "}}");
+  }
+  const auto nodes = Load(std::string_view(text));
+  const auto values = LoadValues(text);
+  ASSERT_EQUAL(print(values.GetRoot()), print(nodes.GetRoot()));
+
+  const Object root = values.GetRoot().AsMap();
+  ASSERT_EQUAL(root.size(), 3u);
+  const Object big = root.at("big").AsMap();
+  for (int i = 1; i <= 20; ++i) {
+    ASSERT_EQUAL(big.at("key" + std::to_string(i)).AsDouble(), static_cast<double>(i));
+  }
+  ASSERT(big.find("key0") == big.end());
+  ASSERT(!root.count("base_requests"));
+
+  // Plain strings point into the text, escaped ones are decoded
+  const auto request = root.at("stat_requests").AsArray()[0].AsMap();
+  const std::string_view name = request.at("name").AsString();
+  ASSERT(name.data() > text.data() && name.data() < text.data() + text.size());
+  ASSERT_EQUAL(root.at("stat_requests").AsArray()[1].AsMap().at("from").AsString(),
+               "Biryulyovo Zapadnoye");
+  ASSERT_EQUAL(root.at("z").AsMap().at("a\"b").AsString(), "c\nd");
+  ASSERT_EQUAL(root.at("z").AsMap().at("k").AsArray().size(), 5u);
+
+  bool thrown = false;
+  try {
+    (void)root.at("z").AsString();
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  ASSERT(thrown);
+
+  // A cleared arena serves the next tree
+  Arena arena;
+  for (int i = 0; i < 3; ++i) {
+    arena.Clear();
+    Reader reader(text);
+    const Value value = reader.ReadValue(arena);
+    reader.Finish();
+    ASSERT_EQUAL(print(value), print(nodes.GetRoot()));
+  }
+}
+
+void WriterLayoutAndEscapes() {
+  using namespace Json;
+  std::map<std::string, Node> answer = {
+      {"request_id", Node(size_t{42})},
+      {"total_time", Node(76.18799999999999)},
+      {"items", Node(std::vector<Node>{Node(std::string("Tverskaya \"ul\"\n20")),
+                                       Node(std::vector<Node>{}), Node(false)})},
+      {"empty", Node(std::map<std::string, Node>{})}};
+
+  std::ostringstream pretty;
+  {
+    Writer writer(pretty);
+    writer.Write(Node(std::vector<Node>{Node(answer), Node(0.1)}));
+  }
+  ASSERT_EQUAL(pretty.str(), R"([
+  {
+    "empty": {},
+    "items": [
+      "Tverskaya \"ul\"\n20",
+      [],
+      false
+    ],
+    "request_id": 42,
+    "total_time": 76.18799999999999
+  },
+  0.1
+])");
+
+  std::ostringstream compact;
+  {
+    Writer writer(compact, true);
+    writer.StartArray();
+    writer.StartObject();
+    writer.Key("time");
+    writer.Number(1e21);
+    writer.Key("tab\t");
+    writer.String(std::string_view("\x01", 1));
+    writer.EndObject();
+    writer.Integer(18446744073709551615u);
+    writer.Bool(true);
+    writer.EndArray();
+  }
+  ASSERT_EQUAL(compact.str(),
+               R"([{"time":1e+21,"tab\t":"\u0001"},18446744073709551615,true])");
+
+  // Written doubles read back exactly
+  std::mt19937_64 generator(7);
+  std::uniform_real_distribution<double> distribution(-1e6, 1e6);
+  for (int i = 0; i < 1000; ++i) {
+    const double value = distribution(generator);
+    std::ostringstream out;
+    Writer(out, true).Number(value);
+    ASSERT_EQUAL(LoadValues(out.str()).GetRoot().AsDouble(), std::stod(out.str()));
+    ASSERT_EQUAL(std::stod(out.str()), value);
+  }
+
+  // The layout of nested ToJson calls is kept
+  std::ostringstream nested;
+  ToJson(std::vector<Node>{Node(answer)}, nested);
+  std::ostringstream whole;
+  ToJson(Node(std::vector<Node>{Node(answer)}), whole);
+  ASSERT_EQUAL(nested.str(), whole.str());
+}
+
+void AnswersWrittenDirectly() {
+  using namespace bus;
+  const std::string text = R"({
+    "base_requests": [
+      {"type": "Stop", "name": "A", "latitude": 55.611087, "longitude": 37.20829,
+       "road_distances": {"B": 3900}},
+      {"type": "Stop", "name": "B", "latitude": 55.595884, "longitude": 37.209755,
+       "road_distances": {}},
+      {"type": "Bus", "name": "750", "stops": ["A", "B"], "is_roundtrip": false}],
+    "stat_requests": [
+      {"type": "Bus", "name": "750", "id": 1},
+      {"type": "Bus", "name": "751", "id": 2},
+      {"type": "Stop", "name": "B", "id": 3},
+      {"type": "Route", "from": "A", "to": "B", "id": 4},
+      {"type": "Route", "from": "A", "to": "A", "id": 5},
+      {"type": "NearestStops", "latitude": 55.611087, "longitude": 37.20829,
+       "count": 1, "id": 6},
+      {"type": "StopSearch", "query": "B", "count": 5, "id": 7}]})";
+
+  BusManagerWithRouter manager{60, 6};
+  const auto doc = Json::LoadValues(text);
+  const auto& root = doc.GetRoot().AsMap();
+  ProcessModifyRequests(ParseRequests(STR_TO_MOD_REQUEST_TYPE, root.at("base_requests")),
+                        manager);
+  const auto network = manager.Freeze();
+
+  std::ostringstream out;
+  {
+    Json::Writer writer(out, true);
+    ProcessReadRequestsToJson(
+        ParseRequests(STR_TO_READ_REQUEST_TYPE, root.at("stat_requests")), *network,
+        writer);
+  }
+  const auto curvature = 7800 / (2 * HaversineDistance({55.611087, 37.20829},
+                                                       {55.595884, 37.209755}));
+  std::ostringstream expected_curvature;
+  Json::Writer(expected_curvature, true).Number(curvature);
+  ASSERT_EQUAL(out.str(),
+               R"([{"curvature":)" + expected_curvature.str() +
+                   R"(,"request_id":1,"route_length":7800,"stop_count":3,"unique_stop_count":2},)"
+                   R"({"error_message":"not found","request_id":2},)"
+                   R"({"buses":["750"],"request_id":3},)"
+                   R"({"items":[{"stop_name":"A","time":6,"type":"Wait"},)"
+                   R"({"bus":"750","span_count":1,"time":3.9,"type":"Bus"}],)"
+                   R"("request_id":4,"total_time":9.9},)"
+                   R"({"items":[],"request_id":5,"total_time":0},)"
+                   R"({"request_id":6,"stops":[{"distance":0,"stop_name":"A"}]},)"
+                   R"({"request_id":7,"stops":["B"]}])");
+}
+
+void StreamedBaseRequests() {
+  using namespace bus;
+  const std::string text = R"({"stat_requests": [{"type": "Stop", "name": "x", "id": 1}],
+    "base_requests": [
+      {"type": "Bus", "name": "750", "stops": ["Tolstopaltsevo", "Marushkino"],
+       "is_roundtrip": false},
+      {"name": "Tolstopaltsevo", "type": "Stop", "latitude": 55.611087,
+       "longitude": 37.20829, "road_distances": {"Marushkino": 3900}},
+      {"type": "Stop", "name": "Marushkino", "latitude": 55.595884,
+       "longitude": 37.209755, "road_distances": {}}],
+    "routing_settings": {"bus_wait_time": 6, "bus_velocity": 40}})";
+
+  BusManager streamed;
+  Json::Reader reader(text);
+  std::vector<std::string> keys;
+  reader.ReadObject([&](std::string_view key) {
+    if (key == "base_requests") {
+      LoadBaseRequests(reader, streamed);
+    } else {
+      reader.SkipValue();
+    }
+    keys.emplace_back(key);
+  });
+  reader.Finish();
+  ASSERT_EQUAL(keys, (std::vector<std::string>{"stat_requests", "base_requests",
+                                               "routing_settings"}));
+
+  BusManager loaded;
+  const auto doc = Json::LoadValues(text);
+  ProcessModifyRequests(
+      ParseRequests(STR_TO_MOD_REQUEST_TYPE, doc.GetRoot().AsMap().at("base_requests")),
+      loaded);
+
+  const auto lhs = streamed.Freeze();
+  const auto rhs = loaded.Freeze();
+  ASSERT_EQUAL(lhs->GetStopCount(), rhs->GetStopCount());
+  const auto& lhs_bus = lhs->FindBus("750")->get();
+  const auto& rhs_bus = rhs->FindBus("750")->get();
+  ASSERT_EQUAL(lhs_bus.stats.route_length, rhs_bus.stats.route_length);
+  ASSERT_EQUAL(lhs_bus.stats.route_length, 7800.0);
+  ASSERT_EQUAL(lhs->FindStop("Marushkino").value(), rhs->FindStop("Marushkino").value());
+}
+
 // END TESTS
 //--------------------------------------------------------------------------------------------
 
@@ -361,18 +1774,18 @@ void PrintRequest(const Info& opt, std::ostream& out = std::cout) {
 }
 
 void ProcessReadRequests(const std::vector<Request::RequestHolder>& requests,
-                         const bus::BusManager& manager) {
+                         const bus::FrozenNetwork& network) {
   for (const auto& request : requests) {
     if (request->type_ == Request::Type::GET_BUS) {
       const auto& read_request =
           static_cast<const GetBusInfoRequest&>(*request);
-      auto info = read_request.Process(manager);
+      auto info = read_request.Process(network);
       std::cout << "Bus " << read_request.name_ << ": ";
       PrintRequest(info);
     } else if (request->type_ == Request::Type::GET_STOP) {
       const auto& read_request =
           static_cast<const GetStopInfoRequest&>(*request);
-      auto info = read_request.Process(manager);
+      auto info = read_request.Process(network);
       std::cout << "Stop " << read_request.name_ << ": ";
       PrintRequest(info);
     } else {
@@ -388,7 +1801,8 @@ void BusinessLogic() {
   auto mod_requests = ParseRequests(STR_TO_MOD_REQUEST_TYPE, std::cin);
   auto read_requests = ParseRequests(STR_TO_READ_REQUEST_TYPE, std::cin);
   ProcessModifyRequests(mod_requests, manager);
-  ProcessReadRequests(read_requests, manager);
+  auto network = manager.Freeze();
+  ProcessReadRequests(read_requests, *network);
 
 }
 
@@ -396,7 +1810,7 @@ void BusinessLogic() {
 // Task 4, adding json support
 
 
-std::optional<Request::Type> GetRequestType(const Json::Node& node,
+std::optional<Request::Type> GetRequestType(const Json::Value& node,
                                             const Dictionary& index) {
   const auto& dict = node.AsMap();
   auto it = dict.find("type");
@@ -414,7 +1828,7 @@ std::optional<Request::Type> GetRequestType(const Json::Node& node,
 }
 
 Request::RequestHolder MakeRequestFromJson(const Dictionary& index,
-                                           const Json::Node& node) {
+                                           const Json::Value& node) {
   const auto request_type = GetRequestType(node, index);
   if (!request_type) {
     throw std::runtime_error("Couldn't identify request from the line");
@@ -425,121 +1839,171 @@ Request::RequestHolder MakeRequestFromJson(const Dictionary& index,
   return request;
 }
 
-Json::Node AnswerToJson(StopInfo& info) {
-  using Json::Node;
-  using namespace std::string_literals;
-  std::map<std::string, Node> result = {
-      {"request_id", Node(info.request_id_)}};
+// Answers are written straight to the output, keys go in alphabetical
+// order as they did from std::map
 
+// Returns true if the answer is an error and has been written completely
+template <typename Info>
+bool WriteError(const Info& info, Json::Writer& writer) {
   if (auto code = info.error_code_) {
-    result.emplace(
-        std::make_pair(std::string("error_message"),
-                       Node(std::string(bus::NUM_TO_ERROR.at(code)))));
-    return Node(std::move(result));
-  }
-
-  const auto& buses = *info.buses_.value();
-  std::vector<Node> copy_buses;
-  copy_buses.reserve(buses.size());
-  std::transform(
-      buses.begin(), buses.end(), std::back_inserter(copy_buses), [](std::string_view sv) {
-        return Node(std::string(sv));
-      });
-
-  result.insert(
-      {"buses", Node(std::move(copy_buses))});
-  return Node(std::move(result));
-}
-
-Json::Node AnswerToJson(BusInfo& info) {
-  using Json::Node;
-  using namespace std::string_literals;
-  std::map<std::string, Node> result = {
-      {"request_id", Node(info.request_id_)}};
-  if (auto code = info.error_code_) {
-    result.emplace(
-        std::make_pair(std::string("error_message"),
-                       Node(std::string(bus::NUM_TO_ERROR.at(code)))));
-    return Node(std::move(result));
+    writer.Key("error_message");
+    writer.String(bus::NUM_TO_ERROR.at(code));
+    writer.Key("request_id");
+    writer.Integer(info.request_id_);
+    writer.EndObject();
+    return true;
+  }
+  return false;
+}
+
+void AnswerToJson(const StopInfo& info, Json::Writer& writer) {
+  writer.StartObject();
+  if (WriteError(info, writer)) {
+    return;
+  }
+  writer.Key("buses");
+  writer.StartArray();
+  for (bus::NameId bus : info.buses_.value()) {
+    writer.String(info.names_->Get(bus));
   }
-  result.insert({"route_length"s, info.route_length_});
-  result.insert({"curvature"s, info.curvature_});
-  result.insert({"stop_count"s, (double)info.stops_on_route_});
-  result.insert({"unique_stop_count"s, (double)info.unique_stops});
-  return Node(std::move(result));
+  writer.EndArray();
+  writer.Key("request_id");
+  writer.Integer(info.request_id_);
+  writer.EndObject();
 }
 
-Json::Node AnswerToJson(RouteInfo& info) {
-  using Json::Node;
-  using namespace std::string_literals;
+void AnswerToJson(const BusInfo& info, Json::Writer& writer) {
+  writer.StartObject();
+  if (WriteError(info, writer)) {
+    return;
+  }
+  writer.Key("curvature");
+  writer.Number(info.curvature_);
+  writer.Key("request_id");
+  writer.Integer(info.request_id_);
+  writer.Key("route_length");
+  writer.Number(info.route_length_);
+  writer.Key("stop_count");
+  writer.Integer(info.stops_on_route_);
+  writer.Key("unique_stop_count");
+  writer.Integer(info.unique_stops);
+  writer.EndObject();
+}
 
+void AnswerToJson(const RouteInfo& info, Json::Writer& writer) {
   struct RouteInfoVarVisitor {
-    Json::Node operator()(WaitRouteItem& item) {
-      std::map<std::string, Node> answer = {
-          {"type"s, "Wait"s},
-          {"time"s, item.time_},
-          {"stop_name"s, std::move(item.stop_name_)}};
-      return Node(std::move(answer));
-    }
-
-    Json::Node operator()(BusRouteItem& item) {
-      std::map<std::string, Node> answer = {
-          {"type"s, "Bus"s},
-          {"time"s, item.time_},
-          {"bus"s, std::move(item.bus_)},
-          {"span_count"s, (double)item.span_count_}};
-      return Node(std::move(answer));
+    void operator()(const WaitRouteItem& item) {
+      writer.Key("stop_name");
+      writer.String(item.stop_name_);
+      writer.Key("time");
+      writer.Number(item.time_);
+      writer.Key("type");
+      writer.String("Wait");
     }
+
+    void operator()(const BusRouteItem& item) {
+      writer.Key("bus");
+      writer.String(item.bus_);
+      writer.Key("span_count");
+      writer.Integer(item.span_count_);
+      writer.Key("time");
+      writer.Number(item.time_);
+      writer.Key("type");
+      writer.String("Bus");
+    }
+
+    Json::Writer& writer;
   };
 
-  std::map<std::string, Node> result = {{"request_id"s, info.request_id_}};
-  if (auto code = info.error_code_) {
-    result.insert(
-        {"error_message"s, std::string(bus::NUM_TO_ERROR.at(code))});
-    return Node(std::move(result));
+  writer.StartObject();
+  if (WriteError(info, writer)) {
+    return;
   }
+  writer.Key("items");
+  writer.StartArray();
+  for (const auto& item : info.route_items_) {
+    writer.StartObject();
+    std::visit(RouteInfoVarVisitor{writer}, item);
+    writer.EndObject();
+  }
+  writer.EndArray();
+  writer.Key("request_id");
+  writer.Integer(info.request_id_);
+  writer.Key("total_time");
+  writer.Number(info.total_time_);
+  writer.EndObject();
+}
 
-  result.insert({"total_time"s, info.total_time_});
-  std::vector<Node> items;
-  items.reserve(info.route_items_.size());
-  std::transform(info.route_items_.begin(), info.route_items_.end(),
-                 std::back_inserter(items), [](auto& var) {
-                   return std::visit(RouteInfoVarVisitor{}, var);
-                 });
-  result.insert({"items"s, std::move(items)});
+void AnswerToJson(const NearestStopsInfo& info, Json::Writer& writer) {
+  writer.StartObject();
+  writer.Key("request_id");
+  writer.Integer(info.request_id_);
+  writer.Key("stops");
+  writer.StartArray();
+  for (const auto& [name, distance] : info.stops_) {
+    writer.StartObject();
+    writer.Key("distance");
+    writer.Number(distance);
+    writer.Key("stop_name");
+    writer.String(name);
+    writer.EndObject();
+  }
+  writer.EndArray();
+  writer.EndObject();
+}
 
-  return Node(std::move(result));
+void AnswerToJson(const StopSearchInfo& info, Json::Writer& writer) {
+  writer.StartObject();
+  writer.Key("request_id");
+  writer.Integer(info.request_id_);
+  writer.Key("stops");
+  writer.StartArray();
+  for (std::string_view name : info.stops_) {
+    writer.String(name);
+  }
+  writer.EndArray();
+  writer.EndObject();
 }
 
-std::vector<Json::Node> ProcessReadRequestsToJson(
-    const std::vector<Request::RequestHolder>& requests,
-    const bus::BusManager& manager) {
-  std::vector<Json::Node> result = {};
+// Writes the array of answers in the order of requests
+void ProcessReadRequestsToJson(const std::vector<Request::RequestHolder>& requests,
+                               const bus::FrozenNetwork& network,
+                               Json::Writer& writer) {
+  writer.StartArray();
   for (const auto& request : requests) {
     if (request->type_ == Request::Type::GET_BUS) {
       const auto& read_request =
           static_cast<const GetBusInfoRequest&>(*request);
-      auto info = read_request.Process(manager);
-      result.push_back(AnswerToJson(info));
+      AnswerToJson(read_request.Process(network), writer);
     } else if (request->type_ == Request::Type::GET_STOP) {
       const auto& read_request =
           static_cast<const GetStopInfoRequest&>(*request);
-      auto info = read_request.Process(manager);
-      result.push_back(AnswerToJson(info));
+      AnswerToJson(read_request.Process(network), writer);
     } else if (request->type_ == Request::Type::GET_ROUTE) {
       const auto& read_request =
           static_cast<const GetRouteInfoRequest&>(*request);
-      auto info = read_request.Process(manager);
-      result.push_back(AnswerToJson(info));
+      AnswerToJson(read_request.Process(network), writer);
+    } else if (request->type_ == Request::Type::GET_ROUTE_VIA) {
+      const auto& read_request =
+          static_cast<const GetRouteViaInfoRequest&>(*request);
+      AnswerToJson(read_request.Process(network), writer);
+    } else if (request->type_ == Request::Type::GET_NEAREST_STOPS) {
+      const auto& read_request =
+          static_cast<const GetNearestStopsRequest&>(*request);
+      AnswerToJson(read_request.Process(network), writer);
+    } else if (request->type_ == Request::Type::SEARCH_STOPS) {
+      const auto& read_request =
+          static_cast<const StopSearchRequest&>(*request);
+      AnswerToJson(read_request.Process(network), writer);
     } else {
       throw std::runtime_error("Unsupported request");
     }
   }
-  return result;
-} 
+  writer.EndArray();
+}
 
 std::vector<Request::RequestHolder> ParseRequests(const Dictionary& index,
-                                                  Json::Node node) {
+                                                  const Json::Value& node) {
   const auto& json_requests = node.AsArray();
   size_t count = json_requests.size();
   std::vector<Request::RequestHolder> requests;
@@ -556,35 +2020,154 @@ std::vector<Request::RequestHolder> ParseRequests(const Dictionary& index,
 
 
 
-void FinalLogic() {
-  using namespace bus;
-  std::fstream Input;
-  Input.open("json_input.txt", std::ios::in);
+// Base requests are applied one by one as the reader reaches them, only
+// the tree of a single request exists at a time and its arena is reused
+void LoadBaseRequests(Json::Reader& reader, bus::BusManager& manager) {
+  Json::Arena arena;
+  reader.ReadArray([&reader, &manager, &arena] {
+    arena.Clear();
+    const auto request = MakeRequestFromJson(STR_TO_MOD_REQUEST_TYPE, reader.ReadValue(arena));
+    static_cast<const ModifyRequest&>(*request).Process(manager);
+  });
+}
 
-  auto doc = Json::Load(Input);
-  auto& dict = doc.GetRoot().AsMap();
+// Elements are parsed and turned into requests in chunks, one per thread,
+// every chunk reusing one arena. Requests come in the order of elements
+std::vector<Request::RequestHolder> ParseRequestsParallel(
+    const Dictionary& index, std::span<const std::string_view> elements,
+    size_t thread_count) {
+  auto chunks = utility::ParallelChunks(
+      elements.size(),
+      [&index, elements](size_t first, size_t last) {
+        std::vector<Request::RequestHolder> requests;
+        requests.reserve(last - first);
+        Json::Arena arena;
+        for (size_t i = first; i < last; ++i) {
+          arena.Clear();
+          Json::Reader reader(elements[i]);
+          const Json::Value node = reader.ReadValue(arena);
+          reader.Finish();
+          requests.push_back(MakeRequestFromJson(index, node));
+        }
+        return requests;
+      },
+      thread_count);
 
-  const auto& routing = dict.at("routing_settings").AsMap();
-  BusManagerWithRouter manager {
-    routing.at("bus_velocity").AsDouble(), routing.at("bus_wait_time").AsDouble()
-  };
+  std::vector<Request::RequestHolder> requests;
+  requests.reserve(elements.size());
+  for (auto& chunk : chunks) {
+    std::move(chunk.begin(), chunk.end(), std::back_inserter(requests));
+  }
+  return requests;
+}
+
+// Base requests parsed at once by several threads, memory for them stays
+// proportional to this rather than to the input
+constexpr size_t kBaseRequestBatch = 4096;
+
+// Network is built from base requests by default. "make_base" saves it to
+// the file of serialization_settings instead of answering, and
+// "process_requests" maps that file and skips base requests. The input is
+// read in one pass, every section but base_requests is kept as a tree.
+// With thread_count above one the input is indexed first, base requests
+// are split by the index and parsed in batches on that many threads, and
+// stat requests are parsed the same way all at once. A given thread_count
+// also limits the graph build, which uses every core otherwise
+void FinalLogic(std::string_view mode = {},
+                std::optional<size_t> threads = std::nullopt) {
+  using namespace bus;
+  if (!mode.empty() && mode != "make_base" && mode != "process_requests") {
+    throw std::invalid_argument("Unknown mode " + std::string(mode));
+  }
+  const size_t thread_count = threads.value_or(1);
+
+  const utility::MappedFile input("json_input.txt");
+  const std::string_view text = input.GetView();
+  const bool parallel = thread_count > 1;
+  Json::Reader reader = parallel ? Json::Reader(text, Json::FindStructurals(text))
+                                 : Json::Reader(text);
+  // Routing settings may follow base requests, they are set before Freeze
+  BusManagerWithRouter manager{0, 0};
+  if (threads) {
+    manager.SetThreadCount(*threads);
+  }
+  Json::Arena arena;
+  std::map<std::string, Json::Value, std::less<>> dict;
+  bool has_base_requests = false;
+  std::optional<std::vector<Request::RequestHolder>> read_requests;
+  reader.ReadObject([&](std::string_view key) {
+    // Like Json::Load, the first of repeated keys is kept
+    if (key == "base_requests") {
+      if (has_base_requests || mode == "process_requests") {
+        reader.SkipValue();
+      } else if (parallel) {
+        has_base_requests = true;
+        reader.SplitArray(kBaseRequestBatch, [&](std::span<const std::string_view> batch) {
+          ProcessModifyRequests(
+              ParseRequestsParallel(STR_TO_MOD_REQUEST_TYPE, batch, thread_count), manager);
+        });
+      } else {
+        has_base_requests = true;
+        LoadBaseRequests(reader, manager);
+      }
+    } else if (key == "stat_requests" && parallel) {
+      if (read_requests) {
+        reader.SkipValue();
+      } else {
+        read_requests = ParseRequestsParallel(STR_TO_READ_REQUEST_TYPE,
+                                              reader.SplitArray(), thread_count);
+      }
+    } else if (dict.count(key)) {
+      reader.SkipValue();
+    } else {
+      dict.emplace(key, reader.ReadValue(arena));
+    }
+  });
+  reader.Finish();
 
-  const auto& modify_requests_nodes = dict.at("base_requests");
-  const auto& read_requests_nodes = dict.at("stat_requests");
+  std::string snapshot_path;
+  if (!mode.empty()) {
+    snapshot_path = dict.at("serialization_settings").AsMap().at("file").AsString();
+  }
+
+  std::shared_ptr<const FrozenNetwork> network;
+  if (mode == "process_requests") {
+    network = LoadSnapshot(snapshot_path);
+  } else {
+    if (!has_base_requests) {
+      throw std::out_of_range("base_requests are missing");
+    }
+    const auto& routing = dict.at("routing_settings").AsMap();
+    RoutingAlgorithm algorithm = RoutingAlgorithm::GRAPH;
+    if (auto it = routing.find("routing_algorithm"); it != routing.end()) {
+      algorithm = STR_TO_ROUTING_ALGORITHM.at(it->second.AsString());
+    }
+    manager.SetRoutingSettings(routing.at("bus_velocity").AsDouble(),
+                               routing.at("bus_wait_time").AsDouble(), algorithm);
+    network = manager.Freeze();
+  }
 
-  auto mod_requests =
-      ParseRequests(STR_TO_MOD_REQUEST_TYPE, modify_requests_nodes);
-  auto read_requests =
-      ParseRequests(STR_TO_READ_REQUEST_TYPE, read_requests_nodes);
+  if (mode == "make_base") {
+    SaveSnapshot(*network, snapshot_path);
+    return;
+  }
 
-  ProcessModifyRequests(mod_requests, manager);
-  manager.InitializeRouter();
+  if (!read_requests) {
+    read_requests = ParseRequests(STR_TO_READ_REQUEST_TYPE, dict.at("stat_requests"));
+  }
 
-  auto nodes = ProcessReadRequestsToJson(read_requests, manager);
-  Json::ToJson(nodes, std::cout);
+  bool compact = false;
+  if (auto it = dict.find("output_settings"); it != dict.end()) {
+    const auto settings = it->second.AsMap();
+    if (auto flag = settings.find("compact"); flag != settings.end()) {
+      compact = flag->second.AsBool();
+    }
+  }
+  Json::Writer writer(std::cout, compact);
+  ProcessReadRequestsToJson(*read_requests, *network, writer);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
   //TestRunner tr;
   //RUN_TEST(tr, MapToJsonTest);
   //RUN_TEST(tr, VecToJsonTest);
@@ -592,17 +2175,57 @@ int main() {
   //RUN_TEST(tr, StopRecordSimple);
   //RUN_TEST(tr, AddGetStop);
   //RUN_TEST(tr, AddGetBus);
+  //RUN_TEST(tr, StopIdsAreDense);
+  //RUN_TEST(tr, RaptorMatchesGraph);
+  //RUN_TEST(tr, GraphEdgesIndependentOfThreads);
+  //RUN_TEST(tr, TimetableEarliestArrival);
+  //RUN_TEST(tr, RouteViaConcatenatesLegs);
+  //RUN_TEST(tr, BusStatsPrecomputed);
+  //RUN_TEST(tr, RoadDistancesFreeze);
+  //RUN_TEST(tr, BatchHaversine);
+  //RUN_TEST(tr, NamePoolInterns);
+  //RUN_TEST(tr, NamePoolPerfectHash);
+  //RUN_TEST(tr, StopBusesSorted);
+  //RUN_TEST(tr, FrozenNetworkServesReads);
+  //RUN_TEST(tr, PublisherSwapsSnapshots);
+  //RUN_TEST(tr, SnapshotRoundTrip);
+  //RUN_TEST(tr, SnapshotRejectsBadIndexes);
+  //RUN_TEST(tr, NearestStopsMatchScan);
+  //RUN_TEST(tr, StopSearchMatchesScan);
   //RUN_TEST(tr, TrimRightLeft);
   //RUN_TEST(tr, TrimEmpty);
   //RUN_TEST(tr, AddBusRequestParser);
   //RUN_TEST(tr, AddStopRequestParser);
+  //RUN_TEST(tr, AddTripRequestParser);
   //RUN_TEST(tr, GetBusRequestParser);
+  //RUN_TEST(tr, GetRouteViaRequestParser);
+  //RUN_TEST(tr, GetNearestStopsRequestParser);
+  //RUN_TEST(tr, StopSearchRequestParser);
   //RUN_TEST(tr, CalculateLengthTest);
   //RUN_TEST(tr, ParseModifyRequestsTest);
   //RUN_TEST(tr, AddBusThenStops);
   //RUN_TEST(tr, ToJsonAndBack);
+  //RUN_TEST(tr, BufferLoadMatchesStream);
+  //RUN_TEST(tr, NumbersReadExactly);
+  //RUN_TEST(tr, ValueTreeMatchesNode);
+  //RUN_TEST(tr, StructuralIndexMatchesReader);
+  //RUN_TEST(tr, StreamedBaseRequests);
+  //RUN_TEST(tr, ParallelRequestsKeepOrder);
+  //RUN_TEST(tr, WriterLayoutAndEscapes);
+  //RUN_TEST(tr, AnswersWrittenDirectly);
   //LOG_DURATION("total");
-  FinalLogic();
+  // Mode and "--threads=N" for parsing requests on N threads, one by default
+  std::string_view mode;
+  std::optional<size_t> thread_count;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--threads=")) {
+      thread_count = ConvertToNum<size_t>(arg.substr(arg.find('=') + 1));
+    } else {
+      mode = arg;
+    }
+  }
+  FinalLogic(mode, thread_count);
   return 0;
 }
 
@@ -6,6 +6,7 @@
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <limits>
 #include <optional>
 #include <unordered_map>
 #include <utility>
@@ -19,8 +20,23 @@ class Router {
   using Graph = DirectedWeightedGraph<Weight>;
 
  public:
+  // Previous edge of routes without edges
+  static constexpr EdgeId kNoEdge = std::numeric_limits<EdgeId>::max();
+
+  struct RouteInternalData {
+    Weight weight;
+    EdgeId prev_edge;
+  };
+  // Best route for every pair of vertices in one array, from * vertex_count
+  // + to. Only a vertex has a route without edges to itself, so a route
+  // between other vertices with prev_edge == kNoEdge is missing
+  using RoutesInternalData = std::vector<RouteInternalData>;
+
   Router(const Graph& graph);
 
+  // Takes routes computed before for the same graph
+  Router(const Graph& graph, RoutesInternalData routes);
+
   using RouteId = uint64_t;
 
   struct RouteInfo {
@@ -30,33 +46,40 @@ class Router {
   };
 
   std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+  // Same route, but edges are given to the caller instead of the route
+  // cache, so the router is not modified and may be shared between threads
+  std::optional<Weight> BuildRoute(VertexId from, VertexId to,
+                                   std::vector<EdgeId>& edges) const;
   EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
   void ReleaseRoute(RouteId route_id);
 
+  const RoutesInternalData& GetRoutesInternalData() const;
+
  private:
   const Graph& graph_;
-
-  struct RouteInternalData {
-    Weight weight;
-    std::optional<EdgeId> prev_edge;
-  };
-  using RoutesInternalData =
-      std::vector<std::vector<std::optional<RouteInternalData>>>;
+  const size_t vertex_count_;
 
   using ExpandedRoute = std::vector<EdgeId>;
   mutable RouteId next_route_id_ = 0;
   mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
 
+  RouteInternalData& GetRoute(VertexId from, VertexId to) {
+    return routes_internal_data_[from * vertex_count_ + to];
+  }
+  const RouteInternalData& GetRoute(VertexId from, VertexId to) const {
+    return routes_internal_data_[from * vertex_count_ + to];
+  }
+  bool HasRoute(VertexId from, VertexId to) const {
+    return from == to || GetRoute(from, to).prev_edge != kNoEdge;
+  }
+
   void InitializeRoutesInternalData(const Graph& graph) {
-    const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-      routes_internal_data_[vertex][vertex] =
-          RouteInternalData{0, std::nullopt};
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
       for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
         const auto& edge = graph.GetEdge(edge_id);
         assert(edge.weight >= 0);
-        auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-        if (!route_internal_data || route_internal_data->weight > edge.weight) {
+        auto& route_internal_data = GetRoute(vertex, edge.to);
+        if (!HasRoute(vertex, edge.to) || route_internal_data.weight > edge.weight) {
           route_internal_data = RouteInternalData{edge.weight, edge_id};
         }
       }
@@ -66,25 +89,26 @@ class Router {
   void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
                   const RouteInternalData& route_from,
                   const RouteInternalData& route_to) {
-    auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
+    auto& route_relaxing = GetRoute(vertex_from, vertex_to);
     const Weight candidate_weight = route_from.weight + route_to.weight;
-    if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-      route_relaxing = {candidate_weight, route_to.prev_edge
+    if (!HasRoute(vertex_from, vertex_to) ||
+        candidate_weight < route_relaxing.weight) {
+      route_relaxing = {candidate_weight, route_to.prev_edge != kNoEdge
                                               ? route_to.prev_edge
                                               : route_from.prev_edge};
     }
   }
 
-  void RelaxRoutesInternalDataThroughVertex(size_t vertex_count,
-                                            VertexId vertex_through) {
-    for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-      if (const auto& route_from =
-              routes_internal_data_[vertex_from][vertex_through]) {
-        for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-          if (const auto& route_to =
-                  routes_internal_data_[vertex_through][vertex_to]) {
-            RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-          }
+  void RelaxRoutesInternalDataThroughVertex(VertexId vertex_through) {
+    for (VertexId vertex_from = 0; vertex_from < vertex_count_; ++vertex_from) {
+      if (!HasRoute(vertex_from, vertex_through)) {
+        continue;
+      }
+      const RouteInternalData route_from = GetRoute(vertex_from, vertex_through);
+      for (VertexId vertex_to = 0; vertex_to < vertex_count_; ++vertex_to) {
+        if (HasRoute(vertex_through, vertex_to)) {
+          RelaxRoute(vertex_from, vertex_to, route_from,
+                     GetRoute(vertex_through, vertex_to));
         }
       }
     }
@@ -96,38 +120,53 @@ class Router {
 template <typename Weight>
 Router<Weight>::Router(const Graph& graph)
     : graph_(graph),
-      routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(
-                                graph.GetVertexCount())) {
+      vertex_count_(graph.GetVertexCount()),
+      routes_internal_data_(vertex_count_ * vertex_count_,
+                            RouteInternalData{0, kNoEdge}) {
   InitializeRoutesInternalData(graph);
 
-  const size_t vertex_count = graph.GetVertexCount();
-  for (VertexId vertex_through = 0; vertex_through < vertex_count;
+  for (VertexId vertex_through = 0; vertex_through < vertex_count_;
        ++vertex_through) {
-    RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    RelaxRoutesInternalDataThroughVertex(vertex_through);
   }
 }
 
 template <typename Weight>
-std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(
-    VertexId from, VertexId to) const {
-  const auto& route_internal_data = routes_internal_data_[from][to];
-  if (!route_internal_data) {
+Router<Weight>::Router(const Graph& graph, RoutesInternalData routes)
+    : graph_(graph),
+      vertex_count_(graph.GetVertexCount()),
+      routes_internal_data_(std::move(routes)) {
+}
+
+template <typename Weight>
+std::optional<Weight> Router<Weight>::BuildRoute(
+    VertexId from, VertexId to, std::vector<EdgeId>& edges) const {
+  if (!HasRoute(from, to)) {
     return std::nullopt;
   }
-  const Weight weight = route_internal_data->weight;
-  std::vector<EdgeId> edges;
-  for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge; edge_id;
-       edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]
-                     ->prev_edge) {
-    edges.push_back(*edge_id);
+  const auto& route_internal_data = GetRoute(from, to);
+  edges.clear();
+  for (EdgeId edge_id = route_internal_data.prev_edge; edge_id != kNoEdge;
+       edge_id = GetRoute(from, graph_.GetEdge(edge_id).from).prev_edge) {
+    edges.push_back(edge_id);
   }
   std::reverse(std::begin(edges), std::end(edges));
+  return route_internal_data.weight;
+}
+
+template <typename Weight>
+std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(
+    VertexId from, VertexId to) const {
+  std::vector<EdgeId> edges;
+  const std::optional<Weight> weight = BuildRoute(from, to, edges);
+  if (!weight) {
+    return std::nullopt;
+  }
 
   const RouteId route_id = next_route_id_++;
   const size_t route_edge_count = edges.size();
   expanded_routes_cache_[route_id] = std::move(edges);
-  return RouteInfo{route_id, weight, route_edge_count};
+  return RouteInfo{route_id, *weight, route_edge_count};
 }
 
 template <typename Weight>
@@ -140,4 +179,10 @@ void Router<Weight>::ReleaseRoute(RouteId route_id) {
   expanded_routes_cache_.erase(route_id);
 }
 
+template <typename Weight>
+auto Router<Weight>::GetRoutesInternalData() const
+    -> const RoutesInternalData& {
+  return routes_internal_data_;
+}
+
 }  // namespace Graph
\ No newline at end of file
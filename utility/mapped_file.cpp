@@ -0,0 +1,87 @@
+#include "mapped_file.h"
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace utility {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+  file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Cannot open " + path);
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size)) {
+    CloseHandle(file_);
+    throw std::runtime_error("Cannot get size of " + path);
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  // Empty files cannot be mapped
+  if (size_ == 0) {
+    return;
+  }
+  mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  const void* view =
+      mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if (!view) {
+    if (mapping_) {
+      CloseHandle(mapping_);
+    }
+    CloseHandle(file_);
+    throw std::runtime_error("Cannot map " + path);
+  }
+  data_ = static_cast<const char*>(view);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+  }
+  CloseHandle(file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open " + path);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot get size of " + path);
+  }
+  size_ = static_cast<size_t>(info.st_size);
+  // Empty files cannot be mapped
+  if (size_ == 0) {
+    close(fd);
+    return;
+  }
+  // The mapping stays valid after the descriptor is closed
+  void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (view == MAP_FAILED) {
+    throw std::runtime_error("Cannot map " + path);
+  }
+  data_ = static_cast<const char*>(view);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+#endif
+
+}  // namespace utility
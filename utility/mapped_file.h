@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+namespace utility {
+
+// Whole file mapped read-only for the lifetime of the object, with mmap or
+// MapViewOfFile. Data is page aligned. Throws std::runtime_error if the
+// file cannot be opened or mapped, empty files give an empty view
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  [[nodiscard]] const char* GetData() const noexcept {
+    return data_;
+  }
+
+  [[nodiscard]] size_t GetSize() const noexcept {
+    return size_;
+  }
+
+  [[nodiscard]] std::string_view GetView() const noexcept {
+    return {data_, size_};
+  }
+
+ private:
+  const char* data_{nullptr};
+  size_t size_{0};
+#ifdef _WIN32
+  HANDLE file_{INVALID_HANDLE_VALUE};
+  HANDLE mapping_{nullptr};
+#endif
+};
+
+}  // namespace utility
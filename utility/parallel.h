@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace utility {
+
+// Splits [0, count) into contiguous chunks, one per hardware thread (or
+// per thread_count threads), and runs func(first, last) for every chunk
+// asynchronously.
+// Results (if any) are returned in chunk order, so merging them does not
+// depend on the number of threads
+template <typename Func,
+          typename Result = std::invoke_result_t<Func, size_t, size_t>>
+auto ParallelChunks(size_t count, Func func,
+                    size_t thread_count = std::thread::hardware_concurrency()) {
+  thread_count = std::max<size_t>(1, std::min(thread_count, count));
+  const size_t chunk_size = std::max<size_t>(1, (count + thread_count - 1) / thread_count);
+
+  std::vector<std::future<Result>> futures;
+  futures.reserve(thread_count);
+  for (size_t first = 0; first < count; first += chunk_size) {
+    const size_t last = std::min(first + chunk_size, count);
+    futures.push_back(std::async(std::launch::async, func, first, last));
+  }
+
+  if constexpr (std::is_void_v<Result>) {
+    for (auto& future : futures) {
+      future.get();
+    }
+  } else {
+    std::vector<Result> results;
+    results.reserve(futures.size());
+    for (auto& future : futures) {
+      results.push_back(future.get());
+    }
+    return results;
+  }
+}
+
+}  // namespace utility
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <string_view>
 
 namespace utility {
@@ -14,8 +15,13 @@ struct pair_hash {
   std::hash<T2> hash2;
 };
 
+// Plain 16 bytes without padding, so edges and routes holding it can be
+// saved and loaded as they are
 struct WeightWithSpan {
-  WeightWithSpan(double t, size_t s = 0, std::string_view r = "") : time(t), span(s), route(r){};
+  // Route of waiting edges
+  static constexpr uint32_t kNoRoute = UINT32_MAX;
+
+  WeightWithSpan(double t, uint32_t s = 0, uint32_t r = kNoRoute) : time(t), span(s), route(r){};
 
   WeightWithSpan& operator+=(const WeightWithSpan& other) & noexcept {
     time += other.time;
@@ -23,8 +29,8 @@ struct WeightWithSpan {
     return *this;
   }
   double time{0};
-  size_t span{0};
-  std::string_view route;
+  uint32_t span{0};
+  uint32_t route{kNoRoute};  // name id of the bus
 };
 
 inline bool operator<(const WeightWithSpan& lhs,